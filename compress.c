@@ -1,9 +1,10 @@
 /** 
  @file compress.c
- @brief An adaptive order-2 PPM range coder
+ @brief An adaptive order-2 PPM range coder and a fast LZ77 coder
 */
 #define ENET_BUILDING_LIB 1
 #include <string.h>
+#include "enet/utility.h"
 #include "enet/enet.h"
 
 typedef struct _ENetSymbol
@@ -33,7 +34,13 @@ enum
 
     ENET_SUBCONTEXT_ORDER = 2,
     ENET_SUBCONTEXT_SYMBOL_DELTA = 2,
-    ENET_SUBCONTEXT_ESCAPE_DELTA = 5
+    ENET_SUBCONTEXT_ESCAPE_DELTA = 5,
+
+    /* a trained model may only fill half the symbols, leaving the rest for the datagram itself */
+    ENET_RANGE_CODER_MODEL_SYMBOLS = 2048,
+    ENET_RANGE_CODER_MODEL_VERSION = 1,
+    ENET_RANGE_CODER_MODEL_HEADER_SIZE = 7,
+    ENET_RANGE_CODER_MODEL_SYMBOL_SIZE = 16
 };
 
 /* context exclusion roughly halves compression speed, so disable for now */
@@ -43,6 +50,9 @@ typedef struct _ENetRangeCoder
 {
     /* only allocate enough symbols for reasonable MTUs, would need to be larger for large file compression */
     ENetSymbol symbols[4096];
+    /* optional trained symbols every datagram starts from instead of an empty model */
+    ENetSymbol * model;
+    size_t modelSymbols;
 } ENetRangeCoder;
 
 void *
@@ -52,6 +62,9 @@ enet_range_coder_create (void)
     if (rangeCoder == NULL)
       return NULL;
 
+    rangeCoder -> model = NULL;
+    rangeCoder -> modelSymbols = 0;
+
     return rangeCoder;
 }
 
@@ -62,6 +75,9 @@ enet_range_coder_destroy (void * context)
     if (rangeCoder == NULL)
       return;
 
+    if (rangeCoder -> model != NULL)
+      enet_free (rangeCoder -> model);
+
     enet_free (rangeCoder);
 }
 
@@ -145,12 +161,26 @@ enet_symbol_rescale (ENetSymbol * symbol)
     } \
 }
 
-#define ENET_RANGE_CODER_FREE_SYMBOLS \
+#define ENET_RANGE_CODER_RESET_SYMBOLS \
 { \
-    if (nextSymbol >= sizeof (rangeCoder -> symbols) / sizeof (ENetSymbol) - ENET_SUBCONTEXT_ORDER ) \
+    if (rangeCoder -> modelSymbols > 0) \
+    { \
+        memcpy (rangeCoder -> symbols, rangeCoder -> model, rangeCoder -> modelSymbols * sizeof (ENetSymbol)); \
+        nextSymbol = rangeCoder -> modelSymbols; \
+        root = rangeCoder -> symbols; \
+    } \
+    else \
     { \
         nextSymbol = 0; \
         ENET_CONTEXT_CREATE (root, ENET_CONTEXT_ESCAPE_MINIMUM, ENET_CONTEXT_SYMBOL_MINIMUM); \
+    } \
+}
+
+#define ENET_RANGE_CODER_FREE_SYMBOLS \
+{ \
+    if (nextSymbol >= sizeof (rangeCoder -> symbols) / sizeof (ENetSymbol) - ENET_SUBCONTEXT_ORDER ) \
+    { \
+        ENET_RANGE_CODER_RESET_SYMBOLS; \
         predicted = 0; \
         order = 0; \
     } \
@@ -243,10 +273,9 @@ ENET_CONTEXT_WALK(context, { \
 })
 #endif
 
-size_t
-enet_range_coder_compress (void * context, const ENetBuffer * inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+static size_t
+enet_range_coder_encode (ENetRangeCoder * rangeCoder, const ENetBuffer * inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 * outData, size_t outLimit, size_t * symbolCount)
 {
-    ENetRangeCoder * rangeCoder = (ENetRangeCoder *) context;
     enet_uint8 * outStart = outData, * outEnd = & outData [outLimit];
     const enet_uint8 * inData, * inEnd;
     enet_uint32 encodeLow = 0, encodeRange = ~0;
@@ -262,7 +291,7 @@ enet_range_coder_compress (void * context, const ENetBuffer * inBuffers, size_t
     inBuffers ++;
     inBufferCount --;
 
-    ENET_CONTEXT_CREATE (root, ENET_CONTEXT_ESCAPE_MINIMUM, ENET_CONTEXT_SYMBOL_MINIMUM);
+    ENET_RANGE_CODER_RESET_SYMBOLS;
 
     for (;;)
     {
@@ -338,9 +367,18 @@ enet_range_coder_compress (void * context, const ENetBuffer * inBuffers, size_t
 
     ENET_RANGE_CODER_FLUSH;
 
+    if (symbolCount != NULL)
+      * symbolCount = nextSymbol;
+
     return (size_t) (outData - outStart);
 }
 
+size_t
+enet_range_coder_compress (void * context, const ENetBuffer * inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    return enet_range_coder_encode ((ENetRangeCoder *) context, inBuffers, inBufferCount, inLimit, outData, outLimit, NULL);
+}
+
 #define ENET_RANGE_CODER_SEED \
 { \
     if (inData < inEnd) decodeCode |= * inData ++ << 24; \
@@ -513,7 +551,7 @@ enet_range_coder_decompress (void * context, const enet_uint8 * inData, size_t i
     if (rangeCoder == NULL || inLimit <= 0)
       return 0;
 
-    ENET_CONTEXT_CREATE (root, ENET_CONTEXT_ESCAPE_MINIMUM, ENET_CONTEXT_SYMBOL_MINIMUM);
+    ENET_RANGE_CODER_RESET_SYMBOLS;
 
     ENET_RANGE_CODER_SEED;
 
@@ -626,6 +664,603 @@ enet_range_coder_decompress (void * context, const enet_uint8 * inData, size_t i
     return (size_t) (outData - outStart);
 }
 
+/** Trains the initial model of a range coder on sample datagrams.
+    @param context range coder context, as returned by enet_range_coder_create()
+    @param samples array of sample datagram contents, as they would be passed to the compressor
+    @param sampleCount number of samples
+    @returns the number of samples the model was trained on, or < 0 on failure
+    @remarks Training continues from any model already trained or loaded, and stops early once
+    the model has grown to half the symbols available to the range coder. Both sides of a
+    connection must use the same model, which is most easily shared through
+    enet_range_coder_save_model() and enet_range_coder_load_model().
+*/
+int
+enet_range_coder_train (void * context, const ENetBuffer * samples, size_t sampleCount)
+{
+    ENetRangeCoder * rangeCoder = (ENetRangeCoder *) context;
+    enet_uint8 * scratch = NULL;
+    size_t scratchSize = 0, sampleIndex;
+
+    if (rangeCoder == NULL)
+      return -1;
+
+    if (rangeCoder -> model == NULL)
+    {
+        rangeCoder -> model = (ENetSymbol *) enet_malloc (ENET_RANGE_CODER_MODEL_SYMBOLS * sizeof (ENetSymbol));
+        if (rangeCoder -> model == NULL)
+          return -1;
+    }
+
+    for (sampleIndex = 0; sampleIndex < sampleCount; ++ sampleIndex)
+    {
+        ENetBuffer sample = samples [sampleIndex];
+        size_t symbolCount = 0;
+
+        /* each byte creates at most one symbol per context order, so limiting the sample keeps the symbols from ever being reset midway */
+        sample.dataLength = ENET_MIN (sample.dataLength,
+                              (sizeof (rangeCoder -> symbols) / sizeof (ENetSymbol) - 2*ENET_SUBCONTEXT_ORDER - rangeCoder -> modelSymbols) / (ENET_SUBCONTEXT_ORDER + 1));
+        if (sample.dataLength <= 0)
+          break;
+
+        if (scratchSize < 2 * sample.dataLength + 16)
+        {
+            if (scratch != NULL)
+              enet_free (scratch);
+            scratchSize = 2 * sample.dataLength + 16;
+            scratch = (enet_uint8 *) enet_malloc (scratchSize);
+            if (scratch == NULL)
+              return -1;
+        }
+
+        if (enet_range_coder_encode (rangeCoder, & sample, 1, sample.dataLength, scratch, scratchSize, & symbolCount) <= 0)
+          continue;
+
+        if (symbolCount > ENET_RANGE_CODER_MODEL_SYMBOLS)
+          break;
+
+        memcpy (rangeCoder -> model, rangeCoder -> symbols, symbolCount * sizeof (ENetSymbol));
+        rangeCoder -> modelSymbols = symbolCount;
+    }
+
+    if (scratch != NULL)
+      enet_free (scratch);
+
+    return (int) sampleIndex;
+}
+
+/** Serializes the trained model of a range coder.
+    @param context range coder context
+    @param data buffer to receive the model, or NULL to only query its size
+    @param dataLength size of the buffer
+    @returns the size of the serialized model, or 0 if there is no model or the buffer is too small
+*/
+size_t
+enet_range_coder_save_model (void * context, enet_uint8 * data, size_t dataLength)
+{
+    ENetRangeCoder * rangeCoder = (ENetRangeCoder *) context;
+    const ENetSymbol * symbol;
+    size_t modelSize;
+
+    if (rangeCoder == NULL || rangeCoder -> modelSymbols <= 0)
+      return 0;
+
+    modelSize = ENET_RANGE_CODER_MODEL_HEADER_SIZE + rangeCoder -> modelSymbols * ENET_RANGE_CODER_MODEL_SYMBOL_SIZE;
+    if (data == NULL)
+      return modelSize;
+    if (dataLength < modelSize)
+      return 0;
+
+    * data ++ = 'E';
+    * data ++ = 'N';
+    * data ++ = 'R';
+    * data ++ = 'C';
+    * data ++ = ENET_RANGE_CODER_MODEL_VERSION;
+    * data ++ = (enet_uint8) (rangeCoder -> modelSymbols >> 8);
+    * data ++ = (enet_uint8) rangeCoder -> modelSymbols;
+
+    for (symbol = rangeCoder -> model; symbol < & rangeCoder -> model [rangeCoder -> modelSymbols]; ++ symbol)
+    {
+        enet_uint16 fields [7];
+        size_t i;
+
+        fields [0] = symbol -> under;
+        fields [1] = symbol -> left;
+        fields [2] = symbol -> right;
+        fields [3] = symbol -> symbols;
+        fields [4] = symbol -> escapes;
+        fields [5] = symbol -> total;
+        fields [6] = symbol -> parent;
+
+        * data ++ = symbol -> value;
+        * data ++ = symbol -> count;
+        for (i = 0; i < sizeof (fields) / sizeof (fields [0]); ++ i)
+        {
+            * data ++ = (enet_uint8) (fields [i] >> 8);
+            * data ++ = (enet_uint8) fields [i];
+        }
+    }
+
+    return modelSize;
+}
+
+/* walks a context's symbols the way enet_symbol_rescale does, checking their ordering and cumulative counts */
+static int
+enet_symbol_validate (const ENetSymbol * model, size_t index, int minimum, int maximum, int limit, enet_uint8 * visited, size_t * total)
+{
+    * total = 0;
+    for (;;)
+    {
+        const ENetSymbol * symbol = & model [index];
+        size_t under = 0;
+
+        if (visited [index] ||
+            symbol -> value < minimum ||
+            symbol -> value > maximum ||
+            symbol -> count <= 0 ||
+            symbol -> count > limit)
+          return -1;
+        visited [index] = 1;
+
+        if (symbol -> left &&
+            enet_symbol_validate (model, index + symbol -> left, minimum, symbol -> value - 1, limit, visited, & under) < 0)
+          return -1;
+        under += symbol -> count;
+        if (symbol -> under != under)
+          return -1;
+        * total += under;
+
+        if (! symbol -> right)
+          return 0;
+        minimum = symbol -> value + 1;
+        index += symbol -> right;
+    }
+}
+
+/** Loads a model previously serialized by enet_range_coder_save_model().
+    @param context range coder context
+    @param data serialized model, or NULL to discard any model so datagrams start from an empty model again
+    @param dataLength size of the serialized model
+    @returns 0 on success, < 0 if the model is malformed
+*/
+int
+enet_range_coder_load_model (void * context, const enet_uint8 * data, size_t dataLength)
+{
+    ENetRangeCoder * rangeCoder = (ENetRangeCoder *) context;
+    ENetSymbol * model;
+    enet_uint8 visited [ENET_RANGE_CODER_MODEL_SYMBOLS];
+    size_t modelSymbols, i;
+
+    if (rangeCoder == NULL)
+      return -1;
+
+    if (data == NULL)
+    {
+        rangeCoder -> modelSymbols = 0;
+        return 0;
+    }
+
+    if (dataLength < ENET_RANGE_CODER_MODEL_HEADER_SIZE ||
+        memcmp (data, "ENRC", 4) != 0 ||
+        data [4] != ENET_RANGE_CODER_MODEL_VERSION)
+      return -1;
+
+    modelSymbols = (data [5] << 8) | data [6];
+    if (modelSymbols <= 0 || modelSymbols > ENET_RANGE_CODER_MODEL_SYMBOLS ||
+        dataLength != ENET_RANGE_CODER_MODEL_HEADER_SIZE + modelSymbols * ENET_RANGE_CODER_MODEL_SYMBOL_SIZE)
+      return -1;
+
+    model = (ENetSymbol *) enet_malloc (ENET_RANGE_CODER_MODEL_SYMBOLS * sizeof (ENetSymbol));
+    if (model == NULL)
+      return -1;
+
+    data += ENET_RANGE_CODER_MODEL_HEADER_SIZE;
+    for (i = 0; i < modelSymbols; ++ i, data += ENET_RANGE_CODER_MODEL_SYMBOL_SIZE)
+    {
+        ENetSymbol * symbol = & model [i];
+
+        symbol -> value = data [0];
+        symbol -> count = data [1];
+        symbol -> under = (data [2] << 8) | data [3];
+        symbol -> left = (data [4] << 8) | data [5];
+        symbol -> right = (data [6] << 8) | data [7];
+        symbol -> symbols = (data [8] << 8) | data [9];
+        symbol -> escapes = (data [10] << 8) | data [11];
+        symbol -> total = (data [12] << 8) | data [13];
+        symbol -> parent = (data [14] << 8) | data [15];
+
+        if (i + symbol -> left >= modelSymbols ||
+            i + symbol -> right >= modelSymbols ||
+            i + symbol -> symbols >= modelSymbols ||
+            symbol -> parent >= modelSymbols)
+          goto malformed;
+    }
+
+    /* every context's total must match its escapes and symbols as the coder would have kept them, or coding could divide by zero */
+    if (model -> escapes < ENET_CONTEXT_ESCAPE_MINIMUM)
+      goto malformed;
+    memset (visited, 0, modelSymbols);
+    for (i = 0; i < modelSymbols; ++ i)
+    {
+        const ENetSymbol * context = & model [i];
+        size_t total = 0;
+
+        if (context -> symbols &&
+            enet_symbol_validate (model, i + context -> symbols, 0, 0xFF,
+                i > 0 ? 0xFF - 2*ENET_SUBCONTEXT_SYMBOL_DELTA : 0xFF - 2*ENET_CONTEXT_SYMBOL_DELTA,
+                visited, & total) < 0)
+          goto malformed;
+        total += context -> escapes + (i > 0 ? 0 : 256*ENET_CONTEXT_SYMBOL_MINIMUM);
+        if (context -> total != total || total > ENET_RANGE_CODER_BOTTOM - 0x100)
+          goto malformed;
+    }
+    /* every symbol other than the root must belong to exactly one context */
+    for (i = 1; i < modelSymbols; ++ i)
+      if (! visited [i])
+        goto malformed;
+
+    /* every context must lead back to the root within the context order, or coding would never terminate */
+    for (i = 1; i < modelSymbols; ++ i)
+    {
+        const ENetSymbol * symbol = & model [i];
+        size_t depth = 0;
+
+        while (symbol != model)
+        {
+            if (++ depth > ENET_SUBCONTEXT_ORDER + 1)
+              goto malformed;
+            symbol = & model [symbol -> parent];
+        }
+    }
+
+    if (rangeCoder -> model != NULL)
+      enet_free (rangeCoder -> model);
+    rangeCoder -> model = model;
+    rangeCoder -> modelSymbols = modelSymbols;
+    return 0;
+
+malformed:
+    enet_free (model);
+    return -1;
+}
+
+/* byte-oriented LZ77 in the style of LZ4, tuned for MTU-sized datagrams rather than large files */
+enum
+{
+    ENET_FAST_LZ_HASH_BITS      = 12,
+    ENET_FAST_LZ_MINIMUM_MATCH  = 4,
+    ENET_FAST_LZ_MAXIMUM_OFFSET = 0xFFFF,
+    ENET_FAST_LZ_SKIP_SHIFT     = 5,
+    ENET_FAST_LZ_RUN_MASK       = 0x0F
+};
+
+typedef struct _ENetFastLZ
+{
+    /* positions are stored relative to a base that advances on every call, so the table never needs clearing */
+    enet_uint32 base;
+    enet_uint32 table [1 << ENET_FAST_LZ_HASH_BITS];
+    /* scratch space for gathering scattered input, only grown when a datagram exceeds its size */
+    enet_uint8 * buffer;
+    size_t bufferSize;
+} ENetFastLZ;
+
+void *
+enet_fast_lz_create (void)
+{
+    ENetFastLZ * fastLZ = (ENetFastLZ *) enet_malloc (sizeof (ENetFastLZ));
+    if (fastLZ == NULL)
+      return NULL;
+
+    fastLZ -> buffer = (enet_uint8 *) enet_malloc (ENET_PROTOCOL_MAXIMUM_MTU);
+    if (fastLZ -> buffer == NULL)
+    {
+        enet_free (fastLZ);
+        return NULL;
+    }
+    fastLZ -> bufferSize = ENET_PROTOCOL_MAXIMUM_MTU;
+
+    fastLZ -> base = 1;
+    memset (fastLZ -> table, 0, sizeof (fastLZ -> table));
+
+    return fastLZ;
+}
+
+void
+enet_fast_lz_destroy (void * context)
+{
+    ENetFastLZ * fastLZ = (ENetFastLZ *) context;
+    if (fastLZ == NULL)
+      return;
+
+    enet_free (fastLZ -> buffer);
+    enet_free (fastLZ);
+}
+
+/* unaligned reads go through memcpy, which compilers reduce to a single load */
+#define ENET_FAST_LZ_READ_32(data, value) memcpy (& (value), (data), sizeof (enet_uint32))
+
+#define ENET_FAST_LZ_HASH(value) (((value) * 2654435761U) >> (32 - ENET_FAST_LZ_HASH_BITS))
+
+#define ENET_FAST_LZ_OUTPUT(value) \
+{ \
+    if (outData >= outEnd) \
+      return 0; \
+    * outData ++ = value; \
+}
+
+#define ENET_FAST_LZ_OUTPUT_LENGTH(length) \
+{ \
+    size_t remaining = (length); \
+    while (remaining >= 0xFF) \
+    { \
+        ENET_FAST_LZ_OUTPUT (0xFF); \
+        remaining -= 0xFF; \
+    } \
+    ENET_FAST_LZ_OUTPUT ((enet_uint8) remaining); \
+}
+
+#define ENET_FAST_LZ_OUTPUT_LITERALS(literals, literalLength, matchLength) \
+{ \
+    ENET_FAST_LZ_OUTPUT ((enet_uint8) ((ENET_MIN (literalLength, ENET_FAST_LZ_RUN_MASK) << 4) | ENET_MIN (matchLength, ENET_FAST_LZ_RUN_MASK))); \
+    if (literalLength >= ENET_FAST_LZ_RUN_MASK) \
+      ENET_FAST_LZ_OUTPUT_LENGTH (literalLength - ENET_FAST_LZ_RUN_MASK); \
+    if ((size_t) (outEnd - outData) < literalLength) \
+      return 0; \
+    memcpy (outData, literals, literalLength); \
+    outData += literalLength; \
+}
+
+#define ENET_FAST_LZ_INPUT_LENGTH(length) \
+{ \
+    enet_uint8 next; \
+    do \
+    { \
+        if (inData >= inEnd) \
+          return 0; \
+        next = * inData ++; \
+        length += next; \
+    } while (next == 0xFF); \
+}
+
+static size_t
+enet_fast_lz_encode (ENetFastLZ * fastLZ, const enet_uint8 * inStart, size_t dictionaryLength, size_t inLength, enet_uint8 * outData, size_t outLimit)
+{
+    enet_uint8 * outStart = outData, * outEnd = & outData [outLimit];
+    const enet_uint8 * inData = & inStart [dictionaryLength], * inEnd = & inStart [inLength], * literals = inData, * dictionary;
+    size_t literalLength;
+    enet_uint32 base;
+
+    if (fastLZ -> base > ~0U - inLength)
+    {
+        memset (fastLZ -> table, 0, sizeof (fastLZ -> table));
+        fastLZ -> base = 1;
+    }
+    base = fastLZ -> base;
+    fastLZ -> base += (enet_uint32) inLength;
+
+    /* a dictionary preceding the input only seeds the table so matches may refer back into it */
+    for (dictionary = inStart; dictionary + ENET_FAST_LZ_MINIMUM_MATCH <= inData; ++ dictionary)
+    {
+        enet_uint32 sequence;
+        ENET_FAST_LZ_READ_32 (dictionary, sequence);
+        fastLZ -> table [ENET_FAST_LZ_HASH (sequence)] = base + (enet_uint32) (dictionary - inStart);
+    }
+
+    while (inEnd - inData >= ENET_FAST_LZ_MINIMUM_MATCH)
+    {
+        enet_uint32 sequence, candidateSequence, candidate, * entry;
+        const enet_uint8 * match, * matchEnd;
+        size_t offset, matchLength;
+
+        ENET_FAST_LZ_READ_32 (inData, sequence);
+        entry = & fastLZ -> table [ENET_FAST_LZ_HASH (sequence)];
+        candidate = * entry;
+        * entry = base + (enet_uint32) (inData - inStart);
+
+        if (candidate < base)
+          goto nextInput;
+
+        match = & inStart [candidate - base];
+        offset = inData - match;
+        if (offset > ENET_FAST_LZ_MAXIMUM_OFFSET)
+          goto nextInput;
+
+        ENET_FAST_LZ_READ_32 (match, candidateSequence);
+        if (candidateSequence != sequence)
+          goto nextInput;
+
+        for (matchEnd = inData + ENET_FAST_LZ_MINIMUM_MATCH, match += ENET_FAST_LZ_MINIMUM_MATCH;
+             matchEnd < inEnd && * matchEnd == * match;
+             ++ matchEnd, ++ match);
+
+        literalLength = inData - literals;
+        matchLength = matchEnd - inData - ENET_FAST_LZ_MINIMUM_MATCH;
+
+        ENET_FAST_LZ_OUTPUT_LITERALS (literals, literalLength, matchLength);
+        ENET_FAST_LZ_OUTPUT ((enet_uint8) (offset & 0xFF));
+        ENET_FAST_LZ_OUTPUT ((enet_uint8) (offset >> 8));
+        if (matchLength >= ENET_FAST_LZ_RUN_MASK)
+          ENET_FAST_LZ_OUTPUT_LENGTH (matchLength - ENET_FAST_LZ_RUN_MASK);
+
+        inData = literals = matchEnd;
+        continue;
+
+    nextInput:
+        /* skip ahead faster the longer no match has been found, so incompressible data is rejected cheaply */
+        inData += 1 + ((inData - literals) >> ENET_FAST_LZ_SKIP_SHIFT);
+    }
+
+    literalLength = inEnd - literals;
+    if (literalLength > 0)
+      ENET_FAST_LZ_OUTPUT_LITERALS (literals, literalLength, 0);
+
+    return (size_t) (outData - outStart);
+}
+
+static const enet_uint8 *
+enet_fast_lz_gather (ENetFastLZ * fastLZ, const enet_uint8 * dictionary, size_t dictionaryLength, const ENetBuffer * inBuffers, size_t inBufferCount, size_t inLimit, size_t * inLength)
+{
+    enet_uint8 * buffer, * bufferEnd;
+
+    if (dictionaryLength + inLimit > fastLZ -> bufferSize)
+    {
+        buffer = (enet_uint8 *) enet_malloc (dictionaryLength + inLimit);
+        if (buffer == NULL)
+          return NULL;
+
+        enet_free (fastLZ -> buffer);
+        fastLZ -> buffer = buffer;
+        fastLZ -> bufferSize = dictionaryLength + inLimit;
+    }
+
+    if (dictionaryLength > 0)
+      memcpy (fastLZ -> buffer, dictionary, dictionaryLength);
+
+    bufferEnd = & fastLZ -> buffer [dictionaryLength + inLimit];
+    for (buffer = & fastLZ -> buffer [dictionaryLength]; inBufferCount > 0 && buffer < bufferEnd; ++ inBuffers, -- inBufferCount)
+    {
+        size_t length = ENET_MIN (inBuffers -> dataLength, (size_t) (bufferEnd - buffer));
+        memcpy (buffer, inBuffers -> data, length);
+        buffer += length;
+    }
+
+    * inLength = buffer - fastLZ -> buffer;
+    return fastLZ -> buffer;
+}
+
+size_t
+enet_fast_lz_compress (void * context, const ENetBuffer * inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    ENetFastLZ * fastLZ = (ENetFastLZ *) context;
+    const enet_uint8 * inData;
+    size_t inLength;
+
+    if (fastLZ == NULL || inBufferCount <= 0 || inLimit <= 0)
+      return 0;
+
+    if (inBufferCount == 1)
+      return enet_fast_lz_encode (fastLZ, (const enet_uint8 *) inBuffers -> data, 0, ENET_MIN (inLimit, inBuffers -> dataLength), outData, outLimit);
+
+    inData = enet_fast_lz_gather (fastLZ, NULL, 0, inBuffers, inBufferCount, inLimit, & inLength);
+    if (inData == NULL)
+      return 0;
+
+    return enet_fast_lz_encode (fastLZ, inData, 0, inLength, outData, outLimit);
+}
+
+size_t
+enet_fast_lz_compress_with_dictionary (void * context, const enet_uint8 * dictionary, size_t dictionaryLength, const ENetBuffer * inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    ENetFastLZ * fastLZ = (ENetFastLZ *) context;
+    const enet_uint8 * inData;
+    size_t inLength;
+
+    if (fastLZ == NULL || inBufferCount <= 0 || inLimit <= 0)
+      return 0;
+
+    /* matches can only reach back a limited distance, so older dictionary contents would be wasted */
+    if (dictionaryLength > ENET_FAST_LZ_MAXIMUM_OFFSET)
+    {
+        dictionary += dictionaryLength - ENET_FAST_LZ_MAXIMUM_OFFSET;
+        dictionaryLength = ENET_FAST_LZ_MAXIMUM_OFFSET;
+    }
+
+    inData = enet_fast_lz_gather (fastLZ, dictionary, dictionaryLength, inBuffers, inBufferCount, inLimit, & inLength);
+    if (inData == NULL || inLength <= dictionaryLength)
+      return 0;
+
+    return enet_fast_lz_encode (fastLZ, inData, dictionaryLength, inLength, outData, outLimit);
+}
+
+static size_t
+enet_fast_lz_decode (const enet_uint8 * dictionary, size_t dictionaryLength, const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    enet_uint8 * outStart = outData, * outEnd = & outData [outLimit];
+    const enet_uint8 * inEnd = & inData [inLimit];
+
+    if (inLimit <= 0)
+      return 0;
+
+    while (inData < inEnd)
+    {
+        enet_uint8 token = * inData ++;
+        size_t literalLength = token >> 4, matchLength = token & ENET_FAST_LZ_RUN_MASK, offset;
+        const enet_uint8 * match;
+
+        if (literalLength >= ENET_FAST_LZ_RUN_MASK)
+          ENET_FAST_LZ_INPUT_LENGTH (literalLength);
+        if ((size_t) (inEnd - inData) < literalLength || (size_t) (outEnd - outData) < literalLength)
+          return 0;
+        memcpy (outData, inData, literalLength);
+        inData += literalLength;
+        outData += literalLength;
+
+        if (inData >= inEnd)
+          break;
+
+        if (inEnd - inData < 2)
+          return 0;
+        offset = inData [0] | (inData [1] << 8);
+        inData += 2;
+        if (offset <= 0 || offset > (size_t) (outData - outStart) + dictionaryLength)
+          return 0;
+
+        if (matchLength >= ENET_FAST_LZ_RUN_MASK)
+          ENET_FAST_LZ_INPUT_LENGTH (matchLength);
+        matchLength += ENET_FAST_LZ_MINIMUM_MATCH;
+        if ((size_t) (outEnd - outData) < matchLength)
+          return 0;
+
+        if (offset > (size_t) (outData - outStart))
+        {
+            /* the match starts inside the dictionary and may continue into the output */
+            size_t dictionaryOffset = offset - (outData - outStart),
+                   length = ENET_MIN (dictionaryOffset, matchLength);
+            memcpy (outData, & dictionary [dictionaryLength - dictionaryOffset], length);
+            outData += length;
+            matchLength -= length;
+        }
+
+        match = outData - offset;
+        if (offset >= matchLength)
+        {
+            memcpy (outData, match, matchLength);
+            outData += matchLength;
+        }
+        else
+        {
+            const enet_uint8 * matchEnd = match + matchLength;
+            while (match < matchEnd)
+              * outData ++ = * match ++;
+        }
+    }
+
+    return (size_t) (outData - outStart);
+}
+
+size_t
+enet_fast_lz_decompress (void * context, const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    if (context == NULL)
+      return 0;
+
+    return enet_fast_lz_decode (NULL, 0, inData, inLimit, outData, outLimit);
+}
+
+size_t
+enet_fast_lz_decompress_with_dictionary (void * context, const enet_uint8 * dictionary, size_t dictionaryLength, const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit)
+{
+    if (context == NULL)
+      return 0;
+
+    if (dictionaryLength > ENET_FAST_LZ_MAXIMUM_OFFSET)
+    {
+        dictionary += dictionaryLength - ENET_FAST_LZ_MAXIMUM_OFFSET;
+        dictionaryLength = ENET_FAST_LZ_MAXIMUM_OFFSET;
+    }
+
+    return enet_fast_lz_decode (dictionary, dictionaryLength, inData, inLimit, outData, outLimit);
+}
+
 /** @defgroup host ENet host functions
     @{
 */
@@ -633,6 +1268,8 @@ enet_range_coder_decompress (void * context, const enet_uint8 * inData, size_t i
 /** Sets the packet compressor the host should use to the default range coder.
     @param host host to enable the range coder for
     @returns 0 on success, < 0 on failure
+    @remarks A model trained with enet_range_coder_train() may afterward be loaded into
+    host->compressor.context with enet_range_coder_load_model(), on both sides of a connection.
 */
 int
 enet_host_compress_with_range_coder (ENetHost * host)
@@ -648,6 +1285,29 @@ enet_host_compress_with_range_coder (ENetHost * host)
     enet_host_compress (host, & compressor);
     return 0;
 }
+
+/** Sets the packet compressor the host should use to the fast LZ coder.
+    @param host host to enable the LZ coder for
+    @returns 0 on success, < 0 on failure
+    @remarks The LZ coder compresses less than the range coder, but at several times the throughput.
+    Both ends of a connection must use the same compressor.
+*/
+int
+enet_host_compress_with_fast_lz (ENetHost * host)
+{
+    ENetCompressor compressor;
+    memset (& compressor, 0, sizeof (compressor));
+    compressor.context = enet_fast_lz_create();
+    if (compressor.context == NULL)
+      return -1;
+    compressor.compress = enet_fast_lz_compress;
+    compressor.decompress = enet_fast_lz_decompress;
+    compressor.destroy = enet_fast_lz_destroy;
+    compressor.compressWithDictionary = enet_fast_lz_compress_with_dictionary;
+    compressor.decompressWithDictionary = enet_fast_lz_decompress_with_dictionary;
+    enet_host_compress (host, & compressor);
+    return 0;
+}
     
 /** @} */
     
@@ -0,0 +1,386 @@
+/**
+ @file  congestion.c
+ @brief ENet delay-based congestion control
+*/
+#define ENET_BUILDING_LIB 1
+#include <string.h>
+#include "enet/utility.h"
+#include "enet/time.h"
+#include "enet/enet.h"
+
+/* A congestion control in the style of BBR: rather than reacting to loss or round trip time
+   variance, it estimates the bottleneck bandwidth as the highest rate at which the peer has
+   acknowledged reliable data over the last few rounds, and the propagation delay as the lowest
+   round trip time seen over the last ten seconds. Their product, the bandwidth-delay product, is
+   how much data the path holds without queueing, and the window is kept at a small multiple of it.
+
+   A round is one minimum round trip time, over which the rate of acknowledged data is sampled. A
+   round in which the window never held back data only shows how much the application sent, so its
+   rate is discarded unless it exceeds the current estimate.
+   The controller starts up by growing the window by the high gain each round until the bandwidth
+   stops growing, drains the queue that built up, then cycles through briefly probing for more
+   bandwidth and draining again. When the minimum round trip time has not been refreshed for ten
+   seconds it shrinks the window for a moment to let queues empty and measure it anew.
+
+   Random loss does not change the model of the path. But when several datagrams and more than a
+   small fraction of the data sent in a round time out, the data that was in transit bounds how much the path or the
+   peer's socket buffer absorbs, as datagrams leave in bursts. The window is then kept below that
+   bound, which is probed upward again in each round without such loss. */
+
+enum
+{
+    ENET_BBR_STARTUP                = 0,
+    ENET_BBR_DRAIN                  = 1,
+    ENET_BBR_PROBE_BANDWIDTH        = 2,
+    ENET_BBR_PROBE_ROUND_TRIP_TIME  = 3,
+
+    ENET_BBR_GAIN_SCALE             = 256,
+    ENET_BBR_HIGH_GAIN              = 739,   /* 2/ln(2), doubling the sending rate each round */
+    ENET_BBR_DRAIN_GAIN             = 88,    /* 1/HIGH_GAIN, draining the queue built during startup in a round */
+    ENET_BBR_WINDOW_GAIN            = 512,
+    ENET_BBR_BANDWIDTH_ROUNDS       = 10,
+    ENET_BBR_FULL_BANDWIDTH_ROUNDS  = 3,
+    ENET_BBR_CYCLE_LENGTH           = 8,
+    ENET_BBR_INITIAL_WINDOW         = 10,    /* in datagrams of the peer's MTU */
+    ENET_BBR_MINIMUM_WINDOW         = 4,     /* in datagrams of the peer's MTU */
+    ENET_BBR_LOSS_THRESHOLD         = 50,    /* loss of more than 1/50 of the data of a round bounds the window */
+    ENET_BBR_LOSS_BETA              = 179,   /* 0.7, how far below the data in transit at a loss the window is bounded */
+    ENET_BBR_ROUND_TRIP_TIME_EXPIRY = 10000,
+    ENET_BBR_PROBE_ROUND_TRIP_TIME_DURATION = 200
+};
+
+static const enet_uint32 cycleGains [ENET_BBR_CYCLE_LENGTH] =
+{
+    ENET_BBR_GAIN_SCALE * 5 / 4, ENET_BBR_GAIN_SCALE * 3 / 4,
+    ENET_BBR_GAIN_SCALE, ENET_BBR_GAIN_SCALE, ENET_BBR_GAIN_SCALE,
+    ENET_BBR_GAIN_SCALE, ENET_BBR_GAIN_SCALE, ENET_BBR_GAIN_SCALE
+};
+
+typedef struct _ENetBBR
+{
+    enet_uint32 mode;
+    enet_uint32 bandwidth [ENET_BBR_BANDWIDTH_ROUNDS];   /* bytes per second acknowledged in each recent round */
+    enet_uint32 round;
+    enet_uint32 roundStart;
+    enet_uint32 roundDelivered;
+    enet_uint32 delivered;
+    enet_uint32 minRoundTripTime;
+    enet_uint32 minRoundTripTimeStamp;
+    enet_uint32 probeRoundTripTimeEnd;
+    enet_uint32 fullBandwidth;
+    enet_uint32 fullBandwidthRounds;
+    int         fullBandwidthReached;
+    enet_uint32 cycleIndex;
+    enet_uint32 cycleStart;
+    enet_uint32 lastSendTime;
+    int         windowLimited;   /* whether the window held back data in the current and previous round, as bits 0 and 1 */
+    enet_uint32 roundLost;
+    enet_uint32 roundSent;
+    enet_uint32 lossTransit;     /* most data in transit at a timeout during the round */
+    enet_uint32 transitLimit;    /* bound on the window from the latest losses, or 0 if none */
+} ENetBBR;
+
+/** @defgroup congestion ENet congestion control
+    @{
+*/
+
+static enet_uint32
+enet_bbr_bandwidth (const ENetBBR * bbr)
+{
+    enet_uint32 bandwidth = 0;
+    int i;
+
+    for (i = 0; i < ENET_BBR_BANDWIDTH_ROUNDS; ++ i)
+      bandwidth = ENET_MAX (bandwidth, bbr -> bandwidth [i]);
+
+    return bandwidth;
+}
+
+static enet_uint32
+enet_bbr_round_trip_time (const ENetBBR * bbr, const ENetPeer * peer)
+{
+    if (bbr -> minRoundTripTime == ~0U)
+      return ENET_MAX (peer -> roundTripTime, 1);
+
+    return ENET_MAX (bbr -> minRoundTripTime, 1);
+}
+
+static enet_uint32
+enet_bbr_delay_product (const ENetBBR * bbr, const ENetPeer * peer, enet_uint32 gain)
+{
+    enet_uint64 product = (enet_uint64) enet_bbr_bandwidth (bbr) * enet_bbr_round_trip_time (bbr, peer) / 1000;
+
+    product = product * gain / ENET_BBR_GAIN_SCALE;
+
+    return product > 0xFFFFFFFFU ? 0xFFFFFFFFU : (enet_uint32) product;
+}
+
+static enet_uint32
+enet_bbr_rate (const ENetBBR * bbr, const ENetPeer * peer)
+{
+    enet_uint32 bandwidth = enet_bbr_bandwidth (bbr), gain;
+    enet_uint64 rate;
+
+    switch (bbr -> mode)
+    {
+    case ENET_BBR_STARTUP: gain = ENET_BBR_HIGH_GAIN; break;
+    case ENET_BBR_DRAIN: gain = ENET_BBR_DRAIN_GAIN; break;
+    case ENET_BBR_PROBE_BANDWIDTH: gain = cycleGains [bbr -> cycleIndex]; break;
+    default: gain = ENET_BBR_GAIN_SCALE; break;
+    }
+
+    if (bandwidth == 0)
+      bandwidth = ENET_BBR_INITIAL_WINDOW * peer -> mtu * 1000 / enet_bbr_round_trip_time (bbr, peer);
+
+    rate = (enet_uint64) bandwidth * gain / ENET_BBR_GAIN_SCALE;
+
+    return rate > 0xFFFFFFFFU ? 0xFFFFFFFFU : (enet_uint32) ENET_MAX (rate, 1);
+}
+
+static void
+enet_bbr_enter_probe_bandwidth (ENetBBR * bbr, enet_uint32 now)
+{
+    bbr -> mode = ENET_BBR_PROBE_BANDWIDTH;
+    /* start anywhere but the draining phase so that peers sharing a bottleneck probe at different times */
+    bbr -> cycleIndex = 2 + bbr -> round % (ENET_BBR_CYCLE_LENGTH - 2);
+    bbr -> cycleStart = now;
+}
+
+static void
+enet_bbr_end_round (ENetBBR * bbr, const ENetPeer * peer, enet_uint32 now)
+{
+    enet_uint32 elapsed = ENET_MAX (ENET_TIME_DIFFERENCE (now, bbr -> roundStart), 1),
+                delivered = bbr -> delivered - bbr -> roundDelivered,
+                bandwidth;
+
+    /* sending at the pacing rate held back data as much as a full window would have */
+    if ((enet_uint64) bbr -> roundSent * 1000 / elapsed >= (enet_uint64) enet_bbr_rate (bbr, peer) / 8 * 7)
+      bbr -> windowLimited |= 1;
+
+    bandwidth = (enet_uint32) ((enet_uint64) delivered * 1000 / elapsed);
+    if (! bbr -> windowLimited)
+      bandwidth = ENET_MAX (bandwidth, enet_bbr_bandwidth (bbr));
+
+    bbr -> bandwidth [++ bbr -> round % ENET_BBR_BANDWIDTH_ROUNDS] = bandwidth;
+    bbr -> roundStart = now;
+    bbr -> roundDelivered = bbr -> delivered;
+
+    /* random loss while the application held back data did not come from overflowing the path */
+    if (bbr -> windowLimited &&
+        bbr -> roundLost >= ENET_BBR_MINIMUM_WINDOW * peer -> mtu &&
+        (enet_uint64) bbr -> roundLost * ENET_BBR_LOSS_THRESHOLD > (enet_uint64) delivered + bbr -> roundLost)
+    {
+        enet_uint32 transitLimit = (enet_uint32) ((enet_uint64) bbr -> lossTransit * ENET_BBR_LOSS_BETA / ENET_BBR_GAIN_SCALE);
+
+        if (bbr -> transitLimit == 0 || transitLimit < bbr -> transitLimit)
+          bbr -> transitLimit = ENET_MAX (transitLimit, ENET_BBR_MINIMUM_WINDOW * peer -> mtu);
+
+        /* loss while still starting up means the window already overflows the path */
+        if (bbr -> mode == ENET_BBR_STARTUP)
+          bbr -> fullBandwidthReached = 1;
+    }
+    else
+    if (bbr -> transitLimit > 0)
+      bbr -> transitLimit += ENET_MAX (bbr -> transitLimit / 16, peer -> mtu);
+
+    bbr -> roundLost = 0;
+    bbr -> roundSent = 0;
+    bbr -> lossTransit = 0;
+    bbr -> windowLimited = (bbr -> windowLimited << 1) & 2;
+
+    /* the bandwidth only stops growing at the path's limit if the round was not limited by the application */
+    if (bbr -> fullBandwidthReached || ! bbr -> windowLimited)
+      return;
+
+    bandwidth = enet_bbr_bandwidth (bbr);
+    if ((enet_uint64) bandwidth * 4 >= (enet_uint64) bbr -> fullBandwidth * 5)
+    {
+        bbr -> fullBandwidth = bandwidth;
+        bbr -> fullBandwidthRounds = 0;
+    }
+    else
+    if (++ bbr -> fullBandwidthRounds >= ENET_BBR_FULL_BANDWIDTH_ROUNDS)
+      bbr -> fullBandwidthReached = 1;
+}
+
+static void * ENET_CALLBACK
+enet_bbr_create (void * context, ENetPeer * peer)
+{
+    ENetBBR * bbr;
+
+    (void) context;
+
+    bbr = (ENetBBR *) enet_malloc (sizeof (ENetBBR));
+    if (bbr == NULL)
+      return NULL;
+
+    memset (bbr, 0, sizeof (ENetBBR));
+
+    bbr -> mode = ENET_BBR_STARTUP;
+    bbr -> minRoundTripTime = ~0U;
+    bbr -> minRoundTripTimeStamp = peer -> host -> serviceTime;
+    bbr -> roundStart = peer -> host -> serviceTime;
+    bbr -> lastSendTime = peer -> host -> serviceTime;
+
+    return bbr;
+}
+
+static void ENET_CALLBACK
+enet_bbr_destroy (void * context, void * state)
+{
+    (void) context;
+
+    enet_free (state);
+}
+
+static void ENET_CALLBACK
+enet_bbr_acknowledge (void * state, ENetPeer * peer, enet_uint32 bytes, enet_uint32 roundTripTime)
+{
+    ENetBBR * bbr = (ENetBBR *) state;
+    enet_uint32 now = peer -> host -> serviceTime;
+
+    bbr -> delivered += bytes;
+
+    if (roundTripTime > 0 &&
+        (roundTripTime <= bbr -> minRoundTripTime ||
+         ENET_TIME_DIFFERENCE (now, bbr -> minRoundTripTimeStamp) > ENET_BBR_ROUND_TRIP_TIME_EXPIRY))
+    {
+        if (roundTripTime > bbr -> minRoundTripTime && bbr -> mode != ENET_BBR_PROBE_ROUND_TRIP_TIME)
+        {
+            bbr -> mode = ENET_BBR_PROBE_ROUND_TRIP_TIME;
+            bbr -> probeRoundTripTimeEnd = now + ENET_BBR_PROBE_ROUND_TRIP_TIME_DURATION;
+        }
+
+        bbr -> minRoundTripTime = roundTripTime;
+        bbr -> minRoundTripTimeStamp = now;
+    }
+
+    if (ENET_TIME_DIFFERENCE (now, bbr -> roundStart) >= enet_bbr_round_trip_time (bbr, peer))
+      enet_bbr_end_round (bbr, peer, now);
+
+    switch (bbr -> mode)
+    {
+    case ENET_BBR_STARTUP:
+        if (bbr -> fullBandwidthReached)
+          bbr -> mode = ENET_BBR_DRAIN;
+        break;
+
+    case ENET_BBR_DRAIN:
+        if (peer -> reliableDataInTransit <= enet_bbr_delay_product (bbr, peer, ENET_BBR_GAIN_SCALE))
+          enet_bbr_enter_probe_bandwidth (bbr, now);
+        break;
+
+    case ENET_BBR_PROBE_BANDWIDTH:
+        if (ENET_TIME_DIFFERENCE (now, bbr -> cycleStart) >= enet_bbr_round_trip_time (bbr, peer))
+        {
+            bbr -> cycleIndex = (bbr -> cycleIndex + 1) % ENET_BBR_CYCLE_LENGTH;
+            bbr -> cycleStart = now;
+        }
+        break;
+
+    case ENET_BBR_PROBE_ROUND_TRIP_TIME:
+        if (! ENET_TIME_LESS (now, bbr -> probeRoundTripTimeEnd))
+        {
+            bbr -> minRoundTripTimeStamp = now;
+
+            if (bbr -> fullBandwidthReached)
+              enet_bbr_enter_probe_bandwidth (bbr, now);
+            else
+              bbr -> mode = ENET_BBR_STARTUP;
+        }
+        break;
+    }
+}
+
+static void ENET_CALLBACK
+enet_bbr_loss (void * state, ENetPeer * peer, enet_uint32 bytes)
+{
+    ENetBBR * bbr = (ENetBBR *) state;
+
+    bbr -> roundLost += bytes;
+    bbr -> lossTransit = ENET_MAX (bbr -> lossTransit, peer -> reliableDataInTransit + bytes);
+}
+
+static enet_uint32 ENET_CALLBACK
+enet_bbr_window (const void * state, const ENetPeer * peer)
+{
+    const ENetBBR * bbr = (const ENetBBR *) state;
+    enet_uint32 window;
+
+    if (bbr -> mode == ENET_BBR_PROBE_ROUND_TRIP_TIME)
+      return ENET_BBR_MINIMUM_WINDOW * peer -> mtu;
+
+    if (enet_bbr_bandwidth (bbr) == 0)
+      return ENET_BBR_INITIAL_WINDOW * peer -> mtu;
+
+    window = enet_bbr_delay_product (bbr, peer, bbr -> mode == ENET_BBR_STARTUP ? ENET_BBR_HIGH_GAIN : ENET_BBR_WINDOW_GAIN);
+    window = ENET_MAX (window, ENET_BBR_MINIMUM_WINDOW * peer -> mtu);
+
+    if (bbr -> transitLimit > 0)
+      window = ENET_MIN (window, bbr -> transitLimit);
+
+    return window;
+}
+
+static void ENET_CALLBACK
+enet_bbr_send (void * state, ENetPeer * peer, enet_uint32 bytes)
+{
+    ENetBBR * bbr = (ENetBBR *) state;
+    enet_uint32 now = peer -> host -> serviceTime;
+
+    /* restart the round after the peer was idle, so that time spent with nothing to send does not count against the bandwidth */
+    if (peer -> reliableDataInTransit == 0 &&
+        ENET_TIME_DIFFERENCE (now, bbr -> lastSendTime) >= enet_bbr_round_trip_time (bbr, peer))
+    {
+        bbr -> roundStart = now;
+        bbr -> roundDelivered = bbr -> delivered;
+        bbr -> roundSent = 0;
+    }
+
+    bbr -> roundSent += bytes;
+    bbr -> lastSendTime = now;
+
+    /* reliable data still waiting once the window is full was held back by it */
+    if (! enet_list_empty (& peer -> outgoingSendReliableCommands) &&
+        peer -> reliableDataInTransit + peer -> mtu > enet_bbr_window (bbr, peer))
+      bbr -> windowLimited |= 1;
+}
+
+static enet_uint32 ENET_CALLBACK
+enet_bbr_pacing_rate (const void * state, const ENetPeer * peer)
+{
+    return enet_bbr_rate ((const ENetBBR *) state, peer);
+}
+
+/** @} */
+
+/** @defgroup host ENet host functions
+    @{
+*/
+
+/** Sets the congestion control the host should use to the built-in delay-based controller.
+    @param host host to enable the controller for
+    @remarks The controller sizes the window of reliable data in transit to each peer from the
+    bandwidth and minimum round trip time it measures, so it neither backs off on random loss nor
+    lets queues build up on paths with a large bandwidth-delay product. Unreliable packets are no
+    longer dropped by the packet throttle, except as required by the bandwidth limits of the host.
+    Only the sending side needs to enable it. Peers whose controller state cannot be allocated,
+    whether now or once they connect, keep using the packet throttle.
+*/
+void
+enet_host_congestion_control_with_bbr (ENetHost * host)
+{
+    ENetCongestionControl congestionControl;
+    memset (& congestionControl, 0, sizeof (congestionControl));
+    congestionControl.context = host;
+    congestionControl.create = enet_bbr_create;
+    congestionControl.destroy = enet_bbr_destroy;
+    congestionControl.acknowledge = enet_bbr_acknowledge;
+    congestionControl.loss = enet_bbr_loss;
+    congestionControl.send = enet_bbr_send;
+    congestionControl.window = enet_bbr_window;
+    congestionControl.pacingRate = enet_bbr_pacing_rate;
+    enet_host_congestion_control (host, & congestionControl);
+}
+
+/** @} */
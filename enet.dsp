@@ -93,6 +93,10 @@ SOURCE=.\host.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\impair.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\list.c
 # End Source File
 # Begin Source File
@@ -105,6 +109,10 @@ SOURCE=.\compress.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\congestion.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\packet.c
 # End Source File
 # Begin Source File
@@ -5,6 +5,7 @@
 #define ENET_BUILDING_LIB 1
 #include <string.h>
 #include "enet/enet.h"
+#include "enet/trace.h"
 
 /** @defgroup host ENet host functions
     @{
@@ -48,12 +49,24 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
     }
     memset (host -> peers, 0, peerCount * sizeof (ENetPeer));
 
+    host -> packetData [0] = (enet_uint8 *) enet_malloc (2 * ENET_PROTOCOL_MAXIMUM_MTU);
+    if (host -> packetData [0] == NULL)
+    {
+       enet_free (host -> peers);
+       enet_free (host);
+
+       return NULL;
+    }
+    host -> packetData [1] = host -> packetData [0] + ENET_PROTOCOL_MAXIMUM_MTU;
+    host -> packetDataSize = ENET_PROTOCOL_MAXIMUM_MTU;
+
     host -> socket = enet_socket_create (ENET_SOCKET_TYPE_DATAGRAM);
     if (host -> socket == ENET_SOCKET_NULL || (address != NULL && enet_socket_bind (host -> socket, address) < 0))
     {
        if (host -> socket != ENET_SOCKET_NULL)
          enet_socket_destroy (host -> socket);
 
+       enet_free (host -> packetData [0]);
        enet_free (host -> peers);
        enet_free (host);
 
@@ -83,6 +96,8 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
     host -> bandwidthThrottleEpoch = 0;
     host -> recalculateBandwidthLimits = 0;
     host -> mtu = ENET_HOST_DEFAULT_MTU;
+    host -> maximumMtu = 0;
+    host -> fragmentationAllowed = 0;
     host -> peerCount = peerCount;
     host -> commandCount = 0;
     host -> bufferCount = 0;
@@ -96,20 +111,34 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
     host -> totalSentPackets = 0;
     host -> totalReceivedData = 0;
     host -> totalReceivedPackets = 0;
-    host -> totalQueued = 0;
+    host -> sendDeferred = 0;
+    host -> sendDeadline = 0;
 
     host -> connectedPeers = 0;
     host -> bandwidthLimitedPeers = 0;
     host -> duplicatePeers = ENET_PROTOCOL_MAXIMUM_PEER_ID;
     host -> maximumPacketSize = ENET_HOST_DEFAULT_MAXIMUM_PACKET_SIZE;
     host -> maximumWaitingData = ENET_HOST_DEFAULT_MAXIMUM_WAITING_DATA;
+    host -> protocolFeatures = 0;
+    memset (& host -> compressionStatistics, 0, sizeof (host -> compressionStatistics));
+    memset (& host -> histograms, 0, sizeof (host -> histograms));
+    memset (& host -> counters, 0, sizeof (host -> counters));
 
     host -> compressor.context = NULL;
     host -> compressor.compress = NULL;
     host -> compressor.decompress = NULL;
     host -> compressor.destroy = NULL;
+    host -> compressor.compressWithDictionary = NULL;
+    host -> compressor.decompressWithDictionary = NULL;
+
+    memset (& host -> congestionControl, 0, sizeof (host -> congestionControl));
 
     host -> intercept = NULL;
+    host -> acknowledge = NULL;
+    host -> abandon = NULL;
+    host -> impairment = NULL;
+    host -> trace = NULL;
+    host -> traceContext = NULL;
 
     enet_list_clear (& host -> dispatchQueue);
 
@@ -157,10 +186,38 @@ enet_host_destroy (ENetHost * host)
     if (host -> compressor.context != NULL && host -> compressor.destroy)
       (* host -> compressor.destroy) (host -> compressor.context);
 
+    if (host -> congestionControl.context != NULL && host -> congestionControl.destroyContext)
+      (* host -> congestionControl.destroyContext) (host -> congestionControl.context);
+
+    enet_host_impair (host, NULL);
+
+    enet_free (host -> packetData [0]);
     enet_free (host -> peers);
     enet_free (host);
 }
 
+/* Grows the buffers datagrams are received and compressed into to hold the given MTU. */
+static int
+enet_host_reserve_packet_data (ENetHost * host, enet_uint32 mtu)
+{
+    enet_uint8 * packetData;
+
+    if (mtu <= host -> packetDataSize)
+      return 0;
+
+    packetData = (enet_uint8 *) enet_malloc (2 * mtu);
+    if (packetData == NULL)
+      return -1;
+
+    enet_free (host -> packetData [0]);
+
+    host -> packetData [0] = packetData;
+    host -> packetData [1] = packetData + mtu;
+    host -> packetDataSize = mtu;
+
+    return 0;
+}
+
 enet_uint32
 enet_host_random (ENetHost * host)
 {
@@ -178,7 +235,11 @@ enet_host_random (ENetHost * host)
     @param data user data supplied to the receiving host 
     @returns a peer representing the foreign host on success, NULL on failure
     @remarks The peer returned will have not completed the connection until enet_host_service()
-    notifies of an ENET_EVENT_TYPE_CONNECT event for the peer.
+    notifies of an ENET_EVENT_TYPE_CONNECT event for the peer. Protocol features the host offers,
+    such as enet_host_compress_history(), are announced in high bits of the MTU it requests. A
+    foreign host predating these features mistakes them for an oversized MTU and clamps it to its
+    own maximum, so hosts that must interoperate with such hosts should leave them all disabled,
+    as they are by default.
 */
 ENetPeer *
 enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelCount, enet_uint32 data)
@@ -208,10 +269,14 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
     if (currentPeer -> channels == NULL)
       return NULL;
     currentPeer -> channelCount = channelCount;
+    ENET_TRACE (host, ENET_TRACE_EVENT_PEER_STATE_CHANGED, peer_state_changed, currentPeer -> incomingPeerID, currentPeer -> state, ENET_PEER_STATE_CONNECTING, 0);
     currentPeer -> state = ENET_PEER_STATE_CONNECTING;
+    enet_peer_congestion_create (currentPeer);
     currentPeer -> address = * address;
     currentPeer -> connectID = enet_host_random (host);
-    currentPeer -> mtu = host -> mtu;
+    currentPeer -> mtu = host -> maximumMtu > host -> mtu ? host -> maximumMtu : host -> mtu;
+    if (currentPeer -> mtu > host -> packetDataSize)
+      currentPeer -> mtu = host -> packetDataSize;
 
     if (host -> outgoingBandwidth == 0)
       currentPeer -> windowSize = ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE;
@@ -234,11 +299,23 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
         channel -> outgoingUnreliableSequenceNumber = 0;
         channel -> incomingReliableSequenceNumber = 0;
         channel -> incomingUnreliableSequenceNumber = 0;
+        channel -> acknowledgedReliableSequenceNumber = 0;
 
         enet_list_clear (& channel -> incomingReliableCommands);
         enet_list_clear (& channel -> incomingUnreliableCommands);
 
         channel -> usedReliableWindows = 0;
+        channel -> compressionYield = ENET_PEER_COMPRESSION_YIELD_SCALE;
+        channel -> flags = 0;
+        channel -> parityGroupLength = 0;
+        channel -> snapshots = NULL;
+        channel -> priority = 0;
+        channel -> weight = ENET_CHANNEL_DEFAULT_WEIGHT;
+        channel -> scheduleStart = 0;
+        channel -> scheduleFinish = 0;
+        channel -> supersedableCommand = NULL;
+        channel -> unorderedWindow = NULL;
+        memset (channel -> acknowledgedSendOrders, 0, sizeof (channel -> acknowledgedSendOrders));
         memset (channel -> reliableWindows, 0, sizeof (channel -> reliableWindows));
     }
         
@@ -247,7 +324,7 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
     command.connect.outgoingPeerID = ENET_HOST_TO_NET_16 (currentPeer -> incomingPeerID);
     command.connect.incomingSessionID = currentPeer -> incomingSessionID;
     command.connect.outgoingSessionID = currentPeer -> outgoingSessionID;
-    command.connect.mtu = ENET_HOST_TO_NET_32 (currentPeer -> mtu);
+    command.connect.mtu = ENET_HOST_TO_NET_32 (currentPeer -> mtu | host -> protocolFeatures);
     command.connect.windowSize = ENET_HOST_TO_NET_32 (currentPeer -> windowSize);
     command.connect.channelCount = ENET_HOST_TO_NET_32 (channelCount);
     command.connect.incomingBandwidth = ENET_HOST_TO_NET_32 (host -> incomingBandwidth);
@@ -303,6 +380,171 @@ enet_host_compress (ENetHost * host, const ENetCompressor * compressor)
       host -> compressor.context = NULL;
 }
 
+/** Sets the congestion control the host should use for its peers.
+    @param host host to configure
+    @param congestionControl callbacks of the congestion control; if NULL, then the packet throttle is used
+    @remarks Peers already connected switch to the new congestion control with fresh state.
+*/
+void
+enet_host_congestion_control (ENetHost * host, const ENetCongestionControl * congestionControl)
+{
+    ENetPeer * currentPeer;
+
+    for (currentPeer = host -> peers;
+         currentPeer < & host -> peers [host -> peerCount];
+         ++ currentPeer)
+      enet_peer_congestion_destroy (currentPeer);
+
+    if (host -> congestionControl.context != NULL && host -> congestionControl.destroyContext)
+      (* host -> congestionControl.destroyContext) (host -> congestionControl.context);
+
+    if (congestionControl)
+      host -> congestionControl = * congestionControl;
+    else
+      host -> congestionControl.context = NULL;
+
+    for (currentPeer = host -> peers;
+         currentPeer < & host -> peers [host -> peerCount];
+         ++ currentPeer)
+    {
+       if (currentPeer -> state != ENET_PEER_STATE_DISCONNECTED &&
+           currentPeer -> state != ENET_PEER_STATE_ZOMBIE)
+         enet_peer_congestion_create (currentPeer);
+    }
+}
+
+/** Enables or disables compressing datagrams against datagrams previously delivered to the same peer.
+    @param host host to configure
+    @param enable nonzero to offer compression history to peers that subsequently connect, 0 to stop offering it
+    @remarks Both sides of a connection must enable compression history, and it only takes effect
+    with a compressor that supports dictionaries, such as enet_host_compress_with_fast_lz(). Only
+    datagrams carrying reliable commands, including pings, are retained as history, so streams of
+    unreliable packets profit from more frequent pings. Connections already established are unaffected.
+*/
+void
+enet_host_compress_history (ENetHost * host, int enable)
+{
+    if (enable)
+      host -> protocolFeatures |= ENET_PROTOCOL_FEATURE_COMPRESSION_HISTORY;
+    else
+      host -> protocolFeatures &= ~ ENET_PROTOCOL_FEATURE_COMPRESSION_HISTORY;
+}
+
+/** Enables or disables acknowledging reliable commands in ranges rather than one by one.
+    @param host host to configure
+    @param enable nonzero to offer range acknowledgements to peers that subsequently connect, 0 to stop offering it
+    @remarks Both sides of a connection must enable range acknowledgements. A single command then
+    acknowledges a run of reliable commands on a channel along with up to 32 more past a gap, so
+    bulk reliable transfers no longer fill return datagrams with acknowledgements. Connections
+    already established are unaffected.
+*/
+void
+enet_host_acknowledge_ranges (ENetHost * host, int enable)
+{
+    if (enable)
+      host -> protocolFeatures |= ENET_PROTOCOL_FEATURE_ACKNOWLEDGE_RANGE;
+    else
+      host -> protocolFeatures &= ~ ENET_PROTOCOL_FEATURE_ACKNOWLEDGE_RANGE;
+}
+
+/** Enables or disables receiving and sending parity fragments.
+    @param host host to configure
+    @param enable nonzero to offer parity fragments to peers that subsequently connect, 0 to stop offering it
+    @remarks Both sides of a connection must enable parity fragments, and a channel only sends
+    them once configured with enet_peer_parity_configure(). Connections already established are
+    unaffected.
+*/
+void
+enet_host_parity_fragments (ENetHost * host, int enable)
+{
+    if (enable)
+      host -> protocolFeatures |= ENET_PROTOCOL_FEATURE_PARITY_FRAGMENT;
+    else
+      host -> protocolFeatures &= ~ ENET_PROTOCOL_FEATURE_PARITY_FRAGMENT;
+}
+
+/** Enables or disables abandoning reliable packets past their retransmit limit or lifetime.
+    @param host host to configure
+    @param enable nonzero to offer skipping abandoned packets to peers that subsequently connect, 0 to stop offering it
+    @remarks Both sides of a connection must enable this for ENetPacket::retransmitLimit and the
+    lifetime of reliable packets to take effect, as a peer unaware of skips would wait forever for
+    an abandoned packet. Otherwise reliable packets are retransmitted until acknowledged. Connections
+    already established are unaffected.
+*/
+void
+enet_host_abandon_packets (ENetHost * host, int enable)
+{
+    if (enable)
+      host -> protocolFeatures |= ENET_PROTOCOL_FEATURE_SKIP;
+    else
+      host -> protocolFeatures &= ~ ENET_PROTOCOL_FEATURE_SKIP;
+}
+
+/** Sets the MTU the host offers to peers that subsequently connect.
+    @param host host to configure
+    @param mtu MTU to offer, clamped between ENET_PROTOCOL_MINIMUM_MTU and ENET_PROTOCOL_MAXIMUM_JUMBO_MTU
+    @retval 0 on success
+    @retval < 0 if buffers for datagrams of that size could not be allocated
+    @remarks Connections use the lesser of the MTUs both sides offer. Jumbo MTUs above
+    ENET_PROTOCOL_MAXIMUM_MTU are only agreed upon with peers that offer them as well, since
+    earlier versions never accept more, and suit paths known to carry datagrams that large, such
+    as loopback or networks with jumbo frames, unless combined with enet_host_discover_mtu().
+    Connections already established are unaffected.
+*/
+int
+enet_host_mtu (ENetHost * host, enet_uint32 mtu)
+{
+    if (mtu < ENET_PROTOCOL_MINIMUM_MTU)
+      mtu = ENET_PROTOCOL_MINIMUM_MTU;
+    else
+    if (mtu > ENET_PROTOCOL_MAXIMUM_JUMBO_MTU)
+      mtu = ENET_PROTOCOL_MAXIMUM_JUMBO_MTU;
+
+    if (enet_host_reserve_packet_data (host, mtu) < 0)
+      return -1;
+
+    host -> mtu = mtu;
+
+    return 0;
+}
+
+/** Enables or disables path MTU discovery.
+    @param host host to configure
+    @param maximumMtu largest MTU to discover for peers that subsequently connect, or 0 to disable discovery
+    @retval 0 on success
+    @retval < 0 if buffers for datagrams of that size could not be allocated
+    @remarks The host offers maximumMtu to connecting peers in place of the MTU set with
+    enet_host_mtu(), which peers instead start out at. Padded pings then probe for the largest MTU up to the one agreed upon that
+    the path carries, and peer -> mtu follows what they confirm, which sizes the fragments of packets
+    sent afterwards. Should reliable commands larger than the minimum MTU repeatedly go unacknowledged,
+    as happens when the path shrinks below the MTU in use, the peer falls back to the minimum MTU and
+    searches again. The MTU agreed upon is the lesser of those both sides offer, so it only exceeds
+    the default if the peer enabled discovery too or raised its MTU, though any peer answers
+    probes. Datagrams are sent with fragmentation disabled while discovery is enabled, so that probes
+    too large for the path are lost rather than fragmented, save for commands sized before the MTU
+    shrank, and disabling discovery again restores the system default. Connections already established
+    are unaffected.
+*/
+int
+enet_host_discover_mtu (ENetHost * host, enet_uint32 maximumMtu)
+{
+    if (maximumMtu != 0 && maximumMtu < ENET_PROTOCOL_MINIMUM_MTU)
+      maximumMtu = ENET_PROTOCOL_MINIMUM_MTU;
+    else
+    if (maximumMtu > ENET_PROTOCOL_MAXIMUM_JUMBO_MTU)
+      maximumMtu = ENET_PROTOCOL_MAXIMUM_JUMBO_MTU;
+
+    if (enet_host_reserve_packet_data (host, maximumMtu) < 0)
+      return -1;
+
+    if ((host -> maximumMtu != 0) != (maximumMtu != 0))
+      enet_socket_set_option (host -> socket, ENET_SOCKOPT_DONTFRAGMENT, maximumMtu != 0);
+
+    host -> maximumMtu = maximumMtu;
+
+    return 0;
+}
+
 /** Limits the maximum allowed channels of future incoming connections.
     @param host host to limit
     @param channelLimit the maximum number of channels allowed; if 0, then this is equivalent to ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT
@@ -319,6 +561,122 @@ enet_host_channel_limit (ENetHost * host, size_t channelLimit)
     host -> channelLimit = channelLimit;
 }
 
+/** Takes a snapshot of the statistics of a host, including latency distributions totaled over
+    every peer it has been connected to.
+    @param host host to query
+    @param statistics where to store the statistics
+*/
+void
+enet_host_get_stats (const ENetHost * host, ENetHostStatistics * statistics)
+{
+    statistics -> histograms = host -> histograms;
+    statistics -> totalSentData = host -> totalSentData;
+    statistics -> totalSentPackets = host -> totalSentPackets;
+    statistics -> totalReceivedData = host -> totalReceivedData;
+    statistics -> totalReceivedPackets = host -> totalReceivedPackets;
+    statistics -> connectedPeers = host -> connectedPeers;
+    statistics -> compressionStatistics = host -> compressionStatistics;
+    statistics -> counters = host -> counters;
+}
+
+/** Sets a callback to receive the events reported by the tracing points of a host.
+    @param host host to trace
+    @param trace callback to receive events, such as enet_trace_ring_write(), or NULL to stop tracing
+    @param context context passed to the callback
+    @remarks Where available, the tracing points are also USDT probes that can be traced externally
+    without setting a callback.
+*/
+void
+enet_host_trace (ENetHost * host, ENetTraceCallback trace, void * context)
+{
+    host -> trace = trace;
+    host -> traceContext = context;
+}
+
+void
+enet_host_emit_trace (ENetHost * host, ENetTraceEvent event, enet_uint16 peerID, enet_uint32 a, enet_uint32 b, enet_uint32 c)
+{
+    ENetTraceRecord record;
+
+    record.time = host -> serviceTime;
+    record.event = (enet_uint16) event;
+    record.peerID = peerID;
+    record.arguments [0] = a;
+    record.arguments [1] = b;
+    record.arguments [2] = c;
+
+    host -> trace (host, & record, host -> traceContext);
+}
+
+/** Trace callback that appends records to an ENetTraceRing passed as the context, overwriting
+    the oldest records once the ring is full.
+*/
+void ENET_CALLBACK
+enet_trace_ring_write (ENetHost * host, const ENetTraceRecord * record, void * context)
+{
+    ENetTraceRing * ring = (ENetTraceRing *) context;
+
+    if (ring -> recordCount == 0)
+      return;
+
+    ring -> records [ring -> writtenRecords % ring -> recordCount] = * record;
+    ++ ring -> writtenRecords;
+}
+
+void
+enet_histogram_add (ENetHistogram * histogram, enet_uint32 value)
+{
+    size_t bucket = 0;
+
+    while (value > 0 && bucket < ENET_HISTOGRAM_BUCKETS - 1)
+    {
+        ++ bucket;
+        value >>= 1;
+    }
+
+    ++ histogram -> buckets [bucket];
+    ++ histogram -> count;
+}
+
+/** Estimates a percentile of the samples in a histogram.
+    @param histogram histogram to query
+    @param permille percentile to estimate in thousandths, such as 990 for the 99th percentile
+    @returns the upper bound of the bucket holding the percentile, or 0 if the histogram is empty;
+    for the last bucket, which is unbounded, its lower bound is returned instead
+*/
+enet_uint32
+enet_histogram_percentile (const ENetHistogram * histogram, enet_uint32 permille)
+{
+    enet_uint32 total = 0, rank;
+    size_t bucket;
+
+    for (bucket = 0; bucket < ENET_HISTOGRAM_BUCKETS; ++ bucket)
+      total += histogram -> buckets [bucket];
+
+    if (total == 0)
+      return 0;
+
+    if (permille > 1000)
+      permille = 1000;
+
+    rank = total / 1000 * permille + total % 1000 * permille / 1000;
+    if (rank >= total)
+      rank = total - 1;
+
+    for (bucket = 0; bucket < ENET_HISTOGRAM_BUCKETS - 1; ++ bucket)
+    {
+        if (rank < histogram -> buckets [bucket])
+          break;
+
+        rank -= histogram -> buckets [bucket];
+    }
+
+    if (bucket >= ENET_HISTOGRAM_BUCKETS - 1)
+      return 1u << (ENET_HISTOGRAM_BUCKETS - 2);
+
+    return bucket > 0 ? (1u << bucket) - 1 : 0;
+}
+
 
 /** Adjusts the bandwidth limits of a host.
     @param host host to adjust
@@ -404,7 +762,11 @@ enet_host_bandwidth_throttle (ENetHost * host)
               peer -> packetThrottleLimit = 1;
             
             if (peer -> packetThrottle > peer -> packetThrottleLimit)
+            {
+              ENET_TRACE (host, ENET_TRACE_EVENT_THROTTLE_CHANGED, throttle_changed, peer -> incomingPeerID, peer -> packetThrottle, peer -> packetThrottleLimit, peer -> roundTripTime);
+
               peer -> packetThrottle = peer -> packetThrottleLimit;
+            }
 
             peer -> outgoingBandwidthThrottleEpoch = timeCurrent;
 
@@ -436,7 +798,11 @@ enet_host_bandwidth_throttle (ENetHost * host)
             peer -> packetThrottleLimit = throttle;
 
             if (peer -> packetThrottle > peer -> packetThrottleLimit)
+            {
+              ENET_TRACE (host, ENET_TRACE_EVENT_THROTTLE_CHANGED, throttle_changed, peer -> incomingPeerID, peer -> packetThrottle, peer -> packetThrottleLimit, peer -> roundTripTime);
+
               peer -> packetThrottle = peer -> packetThrottleLimit;
+            }
 
             peer -> incomingDataTotal = 0;
             peer -> outgoingDataTotal = 0;
@@ -0,0 +1,292 @@
+/**
+ @file  impair.c
+ @brief ENet network impairment emulation
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/utility.h"
+#include "enet/time.h"
+#include "enet/enet.h"
+
+typedef struct _ENetImpairedDatagram
+{
+    enet_uint32 releaseTime;
+    enet_uint32 order;
+    ENetAddress address;
+    size_t dataLength;
+} ENetImpairedDatagram;
+
+typedef struct _ENetImpairer
+{
+    ENetImpairment impairment;
+    ENetInterceptCallback intercept;
+    enet_uint32 randomSeed;
+    int burst;
+    enet_uint32 linkTime;
+    enet_uint32 linkRemainder;
+    enet_uint32 order;
+    size_t datagramCount;
+    ENetImpairedDatagram * datagrams [ENET_IMPAIRMENT_MAXIMUM_DATAGRAMS];
+} ENetImpairer;
+
+/** @defgroup impairment ENet network impairment emulation
+    @{
+*/
+
+static enet_uint32
+enet_impairment_random (ENetImpairer * impairer)
+{
+    /* Mulberry32 by Tommy Ettinger */
+    enet_uint32 n = (impairer -> randomSeed += 0x6D2B79F5U);
+    n = (n ^ (n >> 15)) * (n | 1U);
+    n ^= n + (n ^ (n >> 7)) * (n | 61U);
+    return n ^ (n >> 14);
+}
+
+static int
+enet_impairment_chance (ENetImpairer * impairer, enet_uint32 probability)
+{
+    return probability > 0 && (enet_impairment_random (impairer) % ENET_IMPAIRMENT_PROBABILITY_SCALE) < probability;
+}
+
+static int
+enet_impairment_earlier (const ENetImpairedDatagram * a, const ENetImpairedDatagram * b)
+{
+    if (a -> releaseTime != b -> releaseTime)
+      return ENET_TIME_LESS (a -> releaseTime, b -> releaseTime);
+
+    return a -> order - b -> order >= 0x80000000U;
+}
+
+static void
+enet_impairment_push (ENetImpairer * impairer, ENetImpairedDatagram * datagram)
+{
+    size_t index = impairer -> datagramCount ++;
+
+    while (index > 0)
+    {
+        size_t parent = (index - 1) / 2;
+
+        if (! enet_impairment_earlier (datagram, impairer -> datagrams [parent]))
+          break;
+
+        impairer -> datagrams [index] = impairer -> datagrams [parent];
+        index = parent;
+    }
+
+    impairer -> datagrams [index] = datagram;
+}
+
+static ENetImpairedDatagram *
+enet_impairment_pop (ENetImpairer * impairer)
+{
+    ENetImpairedDatagram * top = impairer -> datagrams [0],
+                         * last = impairer -> datagrams [-- impairer -> datagramCount];
+    size_t index = 0;
+
+    for (;;)
+    {
+        size_t child = 2 * index + 1;
+
+        if (child >= impairer -> datagramCount)
+          break;
+
+        if (child + 1 < impairer -> datagramCount &&
+            enet_impairment_earlier (impairer -> datagrams [child + 1], impairer -> datagrams [child]))
+          ++ child;
+
+        if (! enet_impairment_earlier (impairer -> datagrams [child], last))
+          break;
+
+        impairer -> datagrams [index] = impairer -> datagrams [child];
+        index = child;
+    }
+
+    impairer -> datagrams [index] = last;
+
+    return top;
+}
+
+static int
+enet_impairment_hold (ENetHost * host, ENetImpairer * impairer, enet_uint32 releaseTime)
+{
+    ENetImpairedDatagram * datagram;
+
+    if (impairer -> datagramCount >= ENET_IMPAIRMENT_MAXIMUM_DATAGRAMS)
+      return -1;
+
+    datagram = (ENetImpairedDatagram *) enet_malloc (sizeof (ENetImpairedDatagram) + host -> receivedDataLength);
+    if (datagram == NULL)
+      return -1;
+
+    datagram -> releaseTime = releaseTime;
+    datagram -> order = impairer -> order ++;
+    datagram -> address = host -> receivedAddress;
+    datagram -> dataLength = host -> receivedDataLength;
+    memcpy (& datagram [1], host -> receivedData, host -> receivedDataLength);
+
+    enet_impairment_push (impairer, datagram);
+
+    return 0;
+}
+
+static int ENET_CALLBACK
+enet_impairment_intercept (ENetHost * host, ENetEvent * event)
+{
+    ENetImpairer * impairer = (ENetImpairer *) host -> impairment;
+    const ENetImpairment * impairment = & impairer -> impairment;
+    enet_uint32 releaseTime = host -> serviceTime;
+    int copies = 1;
+
+    if (impairer -> intercept != NULL)
+    {
+        int result = impairer -> intercept (host, event);
+        if (result != 0)
+          return result;
+    }
+
+    if (impairer -> burst)
+    {
+        if (enet_impairment_chance (impairer, impairment -> burstExit))
+          impairer -> burst = 0;
+    }
+    else
+    if (enet_impairment_chance (impairer, impairment -> burstEnter))
+      impairer -> burst = 1;
+
+    if (enet_impairment_chance (impairer, impairer -> burst ? impairment -> burstLoss : impairment -> loss))
+      return 1;
+
+    /* the link is busy until every datagram queued before this one has been serialized */
+    if (impairment -> bandwidth > 0)
+    {
+        if (ENET_TIME_LESS (impairer -> linkTime, host -> serviceTime))
+        {
+            impairer -> linkTime = host -> serviceTime;
+            impairer -> linkRemainder = 0;
+        }
+        else
+        if (ENET_TIME_DIFFERENCE (impairer -> linkTime, host -> serviceTime) >= ENET_IMPAIRMENT_MAXIMUM_QUEUE)
+          return 1;
+
+        impairer -> linkRemainder += host -> receivedDataLength * 1000;
+        impairer -> linkTime += impairer -> linkRemainder / impairment -> bandwidth;
+        impairer -> linkRemainder %= impairment -> bandwidth;
+
+        releaseTime = impairer -> linkTime;
+    }
+
+    if (! enet_impairment_chance (impairer, impairment -> reorder))
+    {
+        releaseTime += impairment -> latency;
+        if (impairment -> jitter > 0)
+          releaseTime += enet_impairment_random (impairer) % (impairment -> jitter + 1);
+    }
+
+    if (enet_impairment_chance (impairer, impairment -> duplicate))
+      ++ copies;
+
+    if (releaseTime == host -> serviceTime && copies == 1)
+      return 0;
+
+    while (copies -- > 0)
+      if (enet_impairment_hold (host, impairer, releaseTime) < 0)
+        break;
+
+    return 1;
+}
+
+/** Subjects datagrams received by a host to emulated network conditions such as latency, loss,
+    reordering, duplication and limited bandwidth. Datagrams are held in a time-ordered heap and
+    released into normal processing by enet_host_service() once due, so impairing both ends of a
+    connection emulates a link with twice the configured latency as its round trip time.
+
+    The emulation is installed as the host's intercept callback. A callback set beforehand keeps
+    seeing every datagram before it is impaired, but the intercept field must not be changed while
+    the impairment is in place.
+
+    @param host host to impair
+    @param impairment conditions to emulate, or NULL to stop impairing the host, which drops any datagrams still held
+    @retval 0 on success
+    @retval < 0 on failure
+*/
+int
+enet_host_impair (ENetHost * host, const ENetImpairment * impairment)
+{
+    ENetImpairer * impairer = (ENetImpairer *) host -> impairment;
+
+    if (impairment == NULL)
+    {
+        if (impairer == NULL)
+          return 0;
+
+        while (impairer -> datagramCount > 0)
+          enet_free (enet_impairment_pop (impairer));
+
+        host -> intercept = impairer -> intercept;
+        host -> impairment = NULL;
+
+        enet_free (impairer);
+
+        return 0;
+    }
+
+    if (impairer == NULL)
+    {
+        impairer = (ENetImpairer *) enet_malloc (sizeof (ENetImpairer));
+        if (impairer == NULL)
+          return -1;
+
+        impairer -> intercept = host -> intercept;
+        impairer -> burst = 0;
+        impairer -> linkTime = 0;
+        impairer -> linkRemainder = 0;
+        impairer -> order = 0;
+        impairer -> datagramCount = 0;
+
+        host -> impairment = impairer;
+        host -> intercept = enet_impairment_intercept;
+    }
+
+    impairer -> impairment = * impairment;
+    impairer -> randomSeed = impairment -> seed;
+
+    return 0;
+}
+
+int
+enet_host_impairment_pending (ENetHost * host, enet_uint32 * releaseTime)
+{
+    ENetImpairer * impairer = (ENetImpairer *) host -> impairment;
+
+    if (impairer == NULL || impairer -> datagramCount == 0)
+      return 0;
+
+    * releaseTime = impairer -> datagrams [0] -> releaseTime;
+
+    return 1;
+}
+
+int
+enet_host_impairment_release (ENetHost * host)
+{
+    ENetImpairer * impairer = (ENetImpairer *) host -> impairment;
+    ENetImpairedDatagram * datagram;
+
+    if (impairer == NULL || impairer -> datagramCount == 0 ||
+        ENET_TIME_LESS (host -> serviceTime, impairer -> datagrams [0] -> releaseTime))
+      return 0;
+
+    datagram = enet_impairment_pop (impairer);
+
+    memcpy (host -> packetData [0], & datagram [1], datagram -> dataLength);
+    host -> receivedData = host -> packetData [0];
+    host -> receivedDataLength = datagram -> dataLength;
+    host -> receivedAddress = datagram -> address;
+
+    enet_free (datagram);
+
+    return 1;
+}
+
+/** @} */
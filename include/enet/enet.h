@@ -58,7 +58,8 @@ typedef enum _ENetSocketOption
    ENET_SOCKOPT_SNDTIMEO  = 7,
    ENET_SOCKOPT_ERROR     = 8,
    ENET_SOCKOPT_NODELAY   = 9,
-   ENET_SOCKOPT_TTL       = 10
+   ENET_SOCKOPT_TTL       = 10,
+   ENET_SOCKOPT_DONTFRAGMENT = 11
 } ENetSocketOption;
 
 typedef enum _ENetSocketShutdown
@@ -148,12 +149,15 @@ typedef struct _ENetPacket
    size_t                   dataLength;      /**< length of data */
    ENetPacketFreeCallback   freeCallback;    /**< function to be called when the packet is no longer in use */
    void *                   userData;        /**< application private data, may be freely modified */
+   enet_uint32              lifetime;        /**< milliseconds an unreliable packet may wait to be sent before it is dropped as stale, or a reliable packet may go unacknowledged before it is abandoned if enet_host_abandon_packets() is enabled, or 0 for no limit; may be set before sending */
+   enet_uint32              retransmitLimit; /**< retransmissions after which a reliable packet is abandoned if enet_host_abandon_packets() is enabled, or 0 for no limit; may be set before sending */
 } ENetPacket;
 
 typedef struct _ENetAcknowledgement
 {
    ENetListNode acknowledgementList;
    enet_uint32  sentTime;
+   enet_uint32  receivedTime;
    ENetProtocol command;
 } ENetAcknowledgement;
 
@@ -164,12 +168,15 @@ typedef struct _ENetOutgoingCommand
    enet_uint16  unreliableSequenceNumber;
    enet_uint32  sentTime;
    enet_uint32  roundTripTimeout;
-   enet_uint32  queueTime;
+   enet_uint64  queueOrder;               /**< position in the peer's send schedule, see enet_peer_priority_configure() */
+   enet_uint64  sendOrder;                /**< position of the latest transmission among the reliable commands sent to the peer */
+   enet_uint32  enqueueTime;
    enet_uint32  fragmentOffset;
    enet_uint16  fragmentLength;
    enet_uint16  sendAttempts;
    ENetProtocol command;
    ENetPacket * packet;
+   enet_uint32 * unacknowledgedFragments; /**< fragments of a reliable packet the peer has yet to acknowledge, shared by the packet's fragments to the peer */
 } ENetOutgoingCommand;
 
 typedef struct _ENetIncomingCommand
@@ -182,6 +189,7 @@ typedef struct _ENetIncomingCommand
    enet_uint32      fragmentsRemaining;
    enet_uint32 *    fragments;
    ENetPacket *     packet;
+   enet_uint32      receiveTime;
 } ENetIncomingCommand;
 
 typedef enum _ENetPeerState
@@ -230,9 +238,66 @@ enum
    ENET_PEER_FREE_UNSEQUENCED_WINDOWS     = 32,
    ENET_PEER_RELIABLE_WINDOWS             = 16,
    ENET_PEER_RELIABLE_WINDOW_SIZE         = 0x1000,
-   ENET_PEER_FREE_RELIABLE_WINDOWS        = 8
+   ENET_PEER_FREE_RELIABLE_WINDOWS        = 8,
+   ENET_PEER_UNORDERED_WINDOW_SIZE        = ENET_PEER_FREE_RELIABLE_WINDOWS * ENET_PEER_RELIABLE_WINDOW_SIZE,
+   ENET_PEER_COMPRESSION_HISTORY          = 4,
+   ENET_PEER_COMPRESSION_HISTORY_INTERVAL = 100,
+   ENET_PEER_COMPRESSION_HISTORY_MINIMUM  = 128,
+   ENET_PEER_COMPRESSION_YIELD_SCALE      = (1 << 16),
+   ENET_PEER_COMPRESSION_YIELD_THRESHOLD  = ENET_PEER_COMPRESSION_YIELD_SCALE / 32,
+   ENET_PEER_COMPRESSION_PROBE_INTERVAL   = 32,
+   ENET_PEER_PACING_BURST_TIME            = 2,
+   ENET_PEER_PACING_BURST_DATAGRAMS       = 2,
+   ENET_PEER_ACKNOWLEDGE_RANGE_SIZE       = 1024,
+   ENET_PEER_FAST_RETRANSMIT_THRESHOLD    = 3,
+   ENET_PEER_MTU_PROBE_ATTEMPTS           = 3,
+   ENET_PEER_MTU_PROBE_GRANULARITY        = 16,
+   ENET_PEER_MTU_PROBE_INTERVAL           = 10 * 60 * 1000,
+   ENET_PEER_MTU_BLACK_HOLE_ATTEMPTS      = 3,
+   ENET_PEER_SCHEDULE_TIME_BITS           = 55,
+   ENET_CHANNEL_DEFAULT_WEIGHT            = 256
 };
 
+typedef enum _ENetChannelFlag
+{
+   /** payload on the channel is never run through the compressor, such as data that is already compressed */
+   ENET_CHANNEL_FLAG_NO_COMPRESS = (1 << 0),
+   /** only the latest value sent on the channel matters, so a packet that is not sent reliably
+       replaces the previous such packet on the channel if none of it was sent yet */
+   ENET_CHANNEL_FLAG_SUPERSEDE   = (1 << 1),
+   /** reliable packets received on the channel are delivered as soon as they are complete
+       rather than in the order they were sent, so a lost packet only delays itself */
+   ENET_CHANNEL_FLAG_UNORDERED   = (1 << 2)
+} ENetChannelFlag;
+
+/** A snapshot retained on a snapshot channel as a baseline for encoding or decoding deltas. */
+typedef struct _ENetSnapshotBaseline
+{
+   enet_uint16  number;
+   enet_uint16  valid;
+   enet_uint8 * data;
+   size_t       dataLength;
+   size_t       dataSize;
+} ENetSnapshotBaseline;
+
+/** State of a channel sending snapshots delta-encoded against the latest snapshot the
+ * peer acknowledged. Baselines are kept in a ring indexed by snapshot number, so a
+ * baseline acknowledged by the receiver stays available on both sides until the sender
+ * has moved more than baselineCount snapshots beyond it, at which point a full snapshot
+ * is sent instead.
+ *
+ * @sa enet_peer_snapshot_configure()
+ */
+typedef struct _ENetSnapshotChannel
+{
+   size_t       baselineCount;
+   enet_uint16  outgoingNumber;
+   enet_uint16  acknowledgedNumber;
+   int          acknowledged;              /**< whether acknowledgedNumber holds any acknowledged snapshot */
+   ENetSnapshotBaseline * outgoingBaselines;
+   ENetSnapshotBaseline * incomingBaselines;
+} ENetSnapshotChannel;
+
 typedef struct _ENetChannel
 {
    enet_uint16  outgoingReliableSequenceNumber;
@@ -241,16 +306,99 @@ typedef struct _ENetChannel
    enet_uint16  reliableWindows [ENET_PEER_RELIABLE_WINDOWS];
    enet_uint16  incomingReliableSequenceNumber;
    enet_uint16  incomingUnreliableSequenceNumber;
+   enet_uint16  acknowledgedReliableSequenceNumber;   /**< latest reliable sequence number queued for acknowledgement */
    ENetList     incomingReliableCommands;
    ENetList     incomingUnreliableCommands;
+   enet_uint32  compressionYield;   /**< recent yield of compressing datagrams mostly carrying this channel, see ENetPeer::compressionYield */
+   enet_uint32  flags;              /**< local options for this channel, see ENetChannelFlag */
+   enet_uint32  parityGroupLength;  /**< unreliable fragments covered by each parity fragment sent on this channel, or 0 for none, see enet_peer_parity_configure() */
+   ENetSnapshotChannel * snapshots; /**< snapshot state if this is a snapshot channel, see enet_peer_snapshot_configure() */
+   enet_uint32  priority;           /**< channels of higher priority are sent first, see enet_peer_priority_configure() */
+   enet_uint32  weight;             /**< share of the bandwidth left to channels of the same priority, see enet_peer_priority_configure() */
+   enet_uint64  scheduleStart;      /**< virtual time at which the latest packet queued on this channel starts sending */
+   enet_uint64  scheduleFinish;     /**< virtual time at which all data queued on this channel is sent */
+   ENetOutgoingCommand * supersedableCommand; /**< first command of the latest unreliable packet queued on this channel while none of it is sent, see ENET_CHANNEL_FLAG_SUPERSEDE */
+   enet_uint32 * unorderedWindow;   /**< bitmap of the reliable sequence numbers ahead of the channel already delivered, see ENET_CHANNEL_FLAG_UNORDERED */
+   enet_uint64  acknowledgedSendOrders [ENET_PEER_FAST_RETRANSMIT_THRESHOLD]; /**< latest transmissions of reliable commands on this channel acknowledged, newest first */
 } ENetChannel;
 
 typedef enum _ENetPeerFlag
 {
    ENET_PEER_FLAG_NEEDS_DISPATCH   = (1 << 0),
-   ENET_PEER_FLAG_CONTINUE_SENDING = (1 << 1)
+   ENET_PEER_FLAG_CONTINUE_SENDING = (1 << 1),
+   ENET_PEER_FLAG_ACKNOWLEDGE_NOW  = (1 << 2)
 } ENetPeerFlag;
 
+enum
+{
+   ENET_HISTOGRAM_BUCKETS = 16
+};
+
+/** A histogram of samples in buckets of exponentially growing size. Bucket 0 counts samples of 0,
+ * and bucket i counts samples from 2^(i-1) up to 2^i - 1, with the last bucket also counting any
+ * larger samples.
+ *
+ * @sa enet_histogram_percentile()
+ */
+typedef struct _ENetHistogram
+{
+   enet_uint32  count;
+   enet_uint32  buckets [ENET_HISTOGRAM_BUCKETS];
+} ENetHistogram;
+
+/** Distributions of latencies measured on a peer or totaled over a host.
+ */
+typedef struct _ENetHistograms
+{
+   ENetHistogram roundTripTime;    /**< milliseconds from sending a reliable command to receiving its acknowledgement */
+   ENetHistogram queueTime;        /**< milliseconds from queuing a command to first sending it */
+   ENetHistogram retransmissions;  /**< times each acknowledged reliable command had to be resent */
+   ENetHistogram reassemblyTime;   /**< milliseconds from the first to the last fragment of a packet arriving */
+} ENetHistograms;
+
+/** Statistics on compressing outgoing datagrams, which the user may reset to 0 as needed to prevent overflow.
+ */
+typedef struct _ENetCompressionStatistics
+{
+   enet_uint32  compressedDatagrams;  /**< datagrams run through the compressor */
+   enet_uint32  bypassedDatagrams;    /**< datagrams sent without trying the compressor because recent yield was too low */
+   enet_uint32  compressorInput;      /**< bytes run through the compressor */
+   enet_uint32  compressorSavings;    /**< bytes saved by sending datagrams compressed */
+   enet_uint32  compressorTime;       /**< microseconds spent in the compressor */
+} ENetCompressionStatistics;
+
+/** A datagram retained so that later datagrams may be compressed against it.
+ */
+typedef struct _ENetCompressionRecord
+{
+   enet_uint8   number;                 /**< nonzero datagram number the record was sent or received as */
+   enet_uint8   acknowledged;           /**< for sent datagrams, whether the peer is known to have received it */
+   enet_uint8   channelID;              /**< channel of the first reliable command in a sent datagram */
+   enet_uint16  reliableSequenceNumber; /**< sequence number of the first reliable command in a sent datagram */
+   enet_uint16  sentTime;               /**< sent time of a sent datagram, as echoed back in its acknowledgements */
+   enet_uint8 * data;
+   size_t       dataLength;
+   size_t       dataSize;
+} ENetCompressionRecord;
+
+/** Per-peer state for compressing datagrams against previously delivered datagrams.
+ *
+ * Only datagrams carrying reliable commands are recorded, and a sent datagram is only used
+ * as a dictionary once one of its reliable commands has been acknowledged in it, so both
+ * directions stay synchronized without any further handshake.
+ *
+ * @sa enet_host_compress_history()
+ */
+typedef struct _ENetCompressionHistory
+{
+   enet_uint8              outgoingNumber;
+   enet_uint32             outgoingRecordTime;
+   ENetCompressionRecord * outgoingDictionary;
+   ENetCompressionRecord   outgoingRecords [ENET_PEER_COMPRESSION_HISTORY];
+   size_t                  nextIncomingRecord;
+   ENetCompressionRecord   incomingRecords [ENET_PEER_COMPRESSION_HISTORY];
+} ENetCompressionHistory;
+
 /**
  * An ENet peer which data packets may be sent or received from. 
  *
@@ -318,8 +466,47 @@ typedef struct _ENetPeer
    enet_uint32   unsequencedWindow [ENET_PEER_UNSEQUENCED_WINDOW_SIZE / 32]; 
    enet_uint32   eventData;
    size_t        totalWaitingData;
+   enet_uint32   protocolFeatures;   /**< protocol extensions agreed upon with the peer during connection, see ENetProtocolFeature */
+   ENetCompressionHistory * compressionHistory;
+   enet_uint32   compressionYield;   /**< recent fraction of datagram size saved by compression as a ratio with respect to the constant ENET_PEER_COMPRESSION_YIELD_SCALE */
+   enet_uint32   compressionProbeCounter;
+   ENetCompressionStatistics compressionStatistics;
+   ENetHistograms histograms;
+   void *        congestionState;    /**< state of the host's congestion control for this peer, or NULL if the packet throttle governs the peer */
+   enet_uint32   pacingBudget;       /**< bytes that may be sent before the peer's datagrams are held back by pacing */
+   enet_uint32   pacingTime;         /**< when the pacing budget was last refilled */
+   enet_uint32   acknowledgementDelay;     /**< longest time acknowledgements are held back waiting for data to accompany them, or 0 to send them at once */
+   enet_uint32   acknowledgementFrequency; /**< number of queued acknowledgements that are sent without further delay, or 0 for no limit */
+   enet_uint32   remoteAcknowledgementDelay; /**< recent peak of the time the peer reported holding back acknowledgements to this host */
+   enet_uint32   mtuProbeMaximum;    /**< MTU agreed upon with the peer, up to which path MTU discovery may raise mtu, or 0 without discovery */
+   enet_uint32   mtuProbeLow;        /**< largest MTU the path to the peer is believed to carry */
+   enet_uint32   mtuProbeHigh;       /**< largest MTU the path to the peer may still turn out to carry */
+   enet_uint32   mtuProbeSize;       /**< size of the probe in transit to the peer, or 0 if none is */
+   enet_uint32   mtuProbeAttempts;   /**< probes of the current size that were lost */
+   enet_uint32   mtuProbeTime;       /**< when the next probe may be sent */
+   enet_uint64   scheduleTime;       /**< virtual time of the latest command sent to the peer, see ENetOutgoingCommand::queueOrder */
+   enet_uint64   reliableSendOrder;  /**< transmissions of reliable commands to the peer so far, see ENetOutgoingCommand::sendOrder */
 } ENetPeer;
 
+/** A snapshot of the statistics of a peer.
+
+    @sa enet_peer_get_stats()
+ */
+typedef struct _ENetPeerStatistics
+{
+   ENetHistograms histograms;
+   enet_uint32   roundTripTime;          /**< mean round trip time in milliseconds */
+   enet_uint32   roundTripTimeVariance;
+   enet_uint32   packetLoss;             /**< mean packet loss of reliable packets as a ratio with respect to the constant ENET_PEER_PACKET_LOSS_SCALE */
+   enet_uint32   packetLossVariance;
+   enet_uint32   packetThrottle;
+   enet_uint32   reliableDataInTransit;
+   size_t        totalWaitingData;       /**< bytes of received packets not yet dispatched to the user */
+   ENetCompressionStatistics compressionStatistics;
+   enet_uint32   congestionWindow;       /**< bytes of reliable data allowed in transit */
+   enet_uint32   pacingRate;             /**< bytes per second the congestion control would pace sends at, or 0 if unpaced */
+} ENetPeerStatistics;
+
 /** An ENet packet compressor for compressing UDP packets before socket sends or receives.
  */
 typedef struct _ENetCompressor
@@ -332,14 +519,176 @@ typedef struct _ENetCompressor
    size_t (ENET_CALLBACK * decompress) (void * context, const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit);
    /** Destroys the context when compression is disabled or the host is destroyed. May be NULL. */
    void (ENET_CALLBACK * destroy) (void * context);
+   /** Compresses like compress, but may refer back into dictionary[0:dictionaryLength-1], which will be passed unchanged to decompressWithDictionary. May be NULL. */
+   size_t (ENET_CALLBACK * compressWithDictionary) (void * context, const enet_uint8 * dictionary, size_t dictionaryLength, const ENetBuffer * inBuffers, size_t inBufferCount, size_t inLimit, enet_uint8 * outData, size_t outLimit);
+   /** Decompresses data produced by compressWithDictionary against the same dictionary. May be NULL. */
+   size_t (ENET_CALLBACK * decompressWithDictionary) (void * context, const enet_uint8 * dictionary, size_t dictionaryLength, const enet_uint8 * inData, size_t inLimit, enet_uint8 * outData, size_t outLimit);
 } ENetCompressor;
 
+/** A congestion control algorithm, replacing the packet throttle in deciding how much reliable
+    data may be in transit to each peer. The hooks are called from enet_host_service() and
+    enet_host_flush() with the state created for the peer concerned.
+ */
+typedef struct _ENetCongestionControl
+{
+   /** Context data for the congestion control. Must be non-NULL. */
+   void * context;
+   /** Creates the state for a peer that begins connecting. Should return NULL on failure, in which case the packet throttle governs the peer. */
+   void * (ENET_CALLBACK * create) (void * context, ENetPeer * peer);
+   /** Destroys the state of a peer when it is reset or the congestion control is replaced. */
+   void (ENET_CALLBACK * destroy) (void * context, void * state);
+   /** Called when bytes of reliable data are acknowledged by the peer, with the round trip time measured for them in milliseconds. */
+   void (ENET_CALLBACK * acknowledge) (void * state, ENetPeer * peer, enet_uint32 bytes, enet_uint32 roundTripTime);
+   /** Called when bytes of reliable data timed out and are about to be retransmitted. May be NULL. */
+   void (ENET_CALLBACK * loss) (void * state, ENetPeer * peer, enet_uint32 bytes);
+   /** Called when a datagram of the given size is sent to the peer. May be NULL. */
+   void (ENET_CALLBACK * send) (void * state, ENetPeer * peer, enet_uint32 bytes);
+   /** Returns the number of bytes of reliable data that may be in transit to the peer. Must not change the state, as it is also queried for statistics. */
+   enet_uint32 (ENET_CALLBACK * window) (const void * state, const ENetPeer * peer);
+   /** Returns the rate in bytes per second at which to pace datagrams to the peer, or 0 to not pace them. Must not change the state. May be NULL. */
+   enet_uint32 (ENET_CALLBACK * pacingRate) (const void * state, const ENetPeer * peer);
+   /** Destroys the context when the congestion control is replaced or the host is destroyed. May be NULL. */
+   void (ENET_CALLBACK * destroyContext) (void * context);
+} ENetCongestionControl;
+
 /** Callback that computes the checksum of the data held in buffers[0:bufferCount-1] */
 typedef enet_uint32 (ENET_CALLBACK * ENetChecksumCallback) (const ENetBuffer * buffers, size_t bufferCount);
 
 /** Callback for intercepting received raw UDP packets. Should return 1 to intercept, 0 to ignore, or -1 to propagate an error. */
 typedef int (ENET_CALLBACK * ENetInterceptCallback) (struct _ENetHost * host, struct _ENetEvent * event);
+
+/** Callback notified once every fragment of a reliable packet has been acknowledged by a peer, along with the
+    round trip time measured by the final acknowledgement. The packet is still valid during the callback, and
+    may be released as soon as it returns. The callback must not reset or disconnect the peer. */
+typedef void (ENET_CALLBACK * ENetAcknowledgeCallback) (struct _ENetPeer * peer, struct _ENetPacket * packet, enet_uint32 roundTripTime);
+
+/** Callback notified when a reliable packet is abandoned to a peer after exceeding its retransmit limit or
+    lifetime, in which case the peer skips it rather than waiting for it, unless it was delivered already. The
+    packet is still valid during the callback, and may be released as soon as it returns. The callback must
+    not reset or disconnect the peer. */
+typedef void (ENET_CALLBACK * ENetAbandonCallback) (struct _ENetPeer * peer, struct _ENetPacket * packet);
  
+/**
+ * Events reported by tracing points, along with the meaning of the three arguments of each.
+ *
+ * @sa enet_host_trace()
+ */
+typedef enum _ENetTraceEvent
+{
+   ENET_TRACE_EVENT_DATAGRAM_SENT         = 0,  /**< bytes sent, number of commands, header flags */
+   ENET_TRACE_EVENT_DATAGRAM_RECEIVED     = 1,  /**< bytes received, sender host, sender port */
+   ENET_TRACE_EVENT_COMMAND_QUEUED        = 2,  /**< command, reliable sequence number, payload length */
+   ENET_TRACE_EVENT_COMMAND_RETRANSMITTED = 3,  /**< command, reliable sequence number, send attempts so far */
+   ENET_TRACE_EVENT_COMMAND_ACKNOWLEDGED  = 4,  /**< command, reliable sequence number, round trip time */
+   ENET_TRACE_EVENT_COMMAND_DROPPED       = 5,  /**< command, reliable sequence number, unreliable sequence number */
+   ENET_TRACE_EVENT_THROTTLE_CHANGED      = 6,  /**< previous throttle, new throttle, round trip time */
+   ENET_TRACE_EVENT_PEER_STATE_CHANGED    = 7   /**< previous state, new state, 0 */
+} ENetTraceEvent;
+
+/** A fixed size binary record of an event reported by a tracing point. */
+typedef struct _ENetTraceRecord
+{
+   enet_uint32 time;            /**< service time of the host when the event occurred */
+   enet_uint16 event;           /**< see ENetTraceEvent */
+   enet_uint16 peerID;          /**< incoming peer ID of the peer concerned, or 0xFFFF for none */
+   enet_uint32 arguments [3];
+} ENetTraceRecord;
+
+/** Callback receiving every event reported by the tracing points of a host. */
+typedef void (ENET_CALLBACK * ENetTraceCallback) (struct _ENetHost * host, const ENetTraceRecord * record, void * context);
+
+/** A ring buffer of trace records in memory supplied by the user, such as a shared or file backed
+ * mapping that another process reads from. Records are written in place and writtenRecords is only
+ * advanced after each record is complete, so the newest record is records [(writtenRecords - 1) % recordCount].
+ * recordCount should be a power of two so that indices stay consistent when writtenRecords wraps.
+ *
+ * @sa enet_trace_ring_write()
+ */
+typedef struct _ENetTraceRing
+{
+   ENetTraceRecord * records;
+   size_t            recordCount;
+   volatile enet_uint32 writtenRecords;
+} ENetTraceRing;
+
+enum
+{
+   ENET_IMPAIRMENT_PROBABILITY_SCALE = (1 << 16),
+   ENET_IMPAIRMENT_MAXIMUM_DATAGRAMS = 4096,
+   ENET_IMPAIRMENT_MAXIMUM_QUEUE     = 1000
+};
+
+/** Conditions of an emulated network link that datagrams received by a host are subjected to.
+ * Loss follows a Gilbert-Elliott model, switching between a good and a bad state with separate
+ * loss probabilities so that losses come in bursts; setting burstLoss equal to loss and leaving
+ * the transition probabilities at 0 gives uniform random loss. Probabilities are ratios with
+ * respect to ENET_IMPAIRMENT_PROBABILITY_SCALE.
+ *
+ * @sa enet_host_impair()
+ */
+typedef struct _ENetImpairment
+{
+   enet_uint32 latency;      /**< milliseconds of delay added to every datagram */
+   enet_uint32 jitter;       /**< maximum milliseconds of random delay added on top of latency */
+   enet_uint32 loss;         /**< probability of losing a datagram in the good state */
+   enet_uint32 burstLoss;    /**< probability of losing a datagram in the bad state */
+   enet_uint32 burstEnter;   /**< probability of moving from the good to the bad state on each datagram */
+   enet_uint32 burstExit;    /**< probability of moving from the bad to the good state on each datagram */
+   enet_uint32 reorder;      /**< probability of a datagram skipping latency and jitter, overtaking those held before it */
+   enet_uint32 duplicate;    /**< probability of a datagram being delivered twice */
+   enet_uint32 bandwidth;    /**< bytes per second the link delivers, or 0 for no limit; datagrams queued for longer than ENET_IMPAIRMENT_MAXIMUM_QUEUE milliseconds are dropped */
+   enet_uint32 seed;         /**< seed for the random number generator, so runs are reproducible */
+} ENetImpairment;
+
+/** Reasons for which a host discards incoming data, or outgoing data that was throttled, expired, superseded or abandoned. */
+typedef enum _ENetDropReason
+{
+   /** datagram too short to hold a protocol header */
+   ENET_DROP_REASON_TRUNCATED          = 0,
+   /** datagram addressed to a peer ID beyond the peer count of the host */
+   ENET_DROP_REASON_BAD_PEER_ID        = 1,
+   /** datagram for a peer that is not connected, or from another address or session than the peer's */
+   ENET_DROP_REASON_SESSION_MISMATCH   = 2,
+   /** compressed datagram that could not be decompressed */
+   ENET_DROP_REASON_DECOMPRESS_FAILED  = 3,
+   /** datagram whose checksum did not match */
+   ENET_DROP_REASON_CHECKSUM_FAILED    = 4,
+   /** datagram whose remaining commands were discarded because a command was malformed or could
+       not be handled; a command discarded for a more specific reason also counts under that one */
+   ENET_DROP_REASON_REJECTED_COMMAND   = 5,
+   /** command with a sequence number too far ahead of the receive window */
+   ENET_DROP_REASON_OUTSIDE_WINDOW     = 6,
+   /** command that was already received, or that is older than what was already delivered */
+   ENET_DROP_REASON_DUPLICATE          = 7,
+   /** command refused because the peer already has maximumWaitingData waiting to be delivered */
+   ENET_DROP_REASON_WAITING_DATA_LIMIT = 8,
+   /** outgoing unreliable command dropped by the packet throttle */
+   ENET_DROP_REASON_THROTTLED          = 9,
+   /** outgoing unreliable command dropped because its packet outlived ENetPacket::lifetime in the queue */
+   ENET_DROP_REASON_EXPIRED            = 10,
+   /** outgoing unreliable command replaced before it was sent by a newer packet on a channel with ENET_CHANNEL_FLAG_SUPERSEDE */
+   ENET_DROP_REASON_SUPERSEDED         = 11,
+   /** outgoing reliable command replaced by a skip after its packet exceeded ENetPacket::retransmitLimit or ENetPacket::lifetime */
+   ENET_DROP_REASON_ABANDONED          = 12,
+   ENET_DROP_REASON_COUNT              = 13
+} ENetDropReason;
+
+/** Monotonic 64-bit counters of the traffic of a host, which never need resetting. Each counter is
+    only ever incremented by the thread servicing the host, so another thread may read it without
+    locking, though a 64-bit counter may be read torn on a platform without atomic 64-bit loads.
+ */
+typedef struct _ENetHostCounters
+{
+   enet_uint64 sentData;                                        /**< bytes of UDP datagrams sent */
+   enet_uint64 sentDatagrams;                                   /**< UDP datagrams sent */
+   enet_uint64 receivedData;                                    /**< bytes of UDP datagrams received */
+   enet_uint64 receivedDatagrams;                               /**< UDP datagrams received */
+   enet_uint64 sentCommands [ENET_PROTOCOL_COMMAND_COUNT];      /**< commands sent, indexed by ENetProtocolCommand */
+   enet_uint64 receivedCommands [ENET_PROTOCOL_COMMAND_COUNT];  /**< well-formed commands received, indexed by ENetProtocolCommand */
+   enet_uint64 drops [ENET_DROP_REASON_COUNT];                  /**< datagrams or commands discarded, indexed by ENetDropReason */
+   enet_uint64 recoveredFragments;                              /**< lost unreliable fragments rebuilt from parity fragments */
+} ENetHostCounters;
+
 /** An ENet host for communicating with peers.
   *
   * No fields should be modified unless otherwise stated.
@@ -352,6 +701,12 @@ typedef int (ENET_CALLBACK * ENetInterceptCallback) (struct _ENetHost * host, st
     @sa enet_host_broadcast()
     @sa enet_host_compress()
     @sa enet_host_compress_with_range_coder()
+    @sa enet_host_compress_with_fast_lz()
+    @sa enet_host_compress_history()
+    @sa enet_host_acknowledge_ranges()
+    @sa enet_host_parity_fragments()
+    @sa enet_host_mtu()
+    @sa enet_host_discover_mtu()
     @sa enet_host_channel_limit()
     @sa enet_host_bandwidth_limit()
     @sa enet_host_bandwidth_throttle()
@@ -364,6 +719,8 @@ typedef struct _ENetHost
    enet_uint32          outgoingBandwidth;           /**< upstream bandwidth of the host */
    enet_uint32          bandwidthThrottleEpoch;
    enet_uint32          mtu;
+   enet_uint32          maximumMtu;                  /**< largest MTU path MTU discovery may raise peers' MTU to, or 0 if disabled, see enet_host_discover_mtu() */
+   int                  fragmentationAllowed;        /**< whether the don't-fragment option is cleared for commands sized for an MTU that since shrank */
    enet_uint32          randomSeed;
    int                  recalculateBandwidthLimits;
    ENetPeer *           peers;                       /**< array of peers allocated for this host */
@@ -371,16 +728,20 @@ typedef struct _ENetHost
    size_t               channelLimit;                /**< maximum number of channels allowed for connected peers */
    enet_uint32          serviceTime;
    ENetList             dispatchQueue;
-   enet_uint32          totalQueued;
    size_t               packetSize;
    enet_uint16          headerFlags;
+   int                  packetCompressible;
+   int                  sendDeferred;                /**< whether pacing or delayed acknowledgements held back datagrams to some peer during the last send */
+   enet_uint32          sendDeadline;                /**< when the first of the held back datagrams may be sent */
    ENetProtocol         commands [ENET_PROTOCOL_MAXIMUM_PACKET_COMMANDS];
    size_t               commandCount;
    ENetBuffer           buffers [ENET_BUFFER_MAXIMUM];
    size_t               bufferCount;
    ENetChecksumCallback checksum;                    /**< callback the user can set to enable packet checksums for this host */
    ENetCompressor       compressor;
-   enet_uint8           packetData [2][ENET_PROTOCOL_MAXIMUM_MTU];
+   ENetCongestionControl congestionControl;         /**< congestion control of the host's peers, whose context is NULL while the packet throttle is used */
+   enet_uint8 *         packetData [2];
+   size_t               packetDataSize;              /**< size of each of the packetData buffers, at least the largest MTU the host offers */
    ENetAddress          receivedAddress;
    enet_uint8 *         receivedData;
    size_t               receivedDataLength;
@@ -389,13 +750,38 @@ typedef struct _ENetHost
    enet_uint32          totalReceivedData;           /**< total data received, user should reset to 0 as needed to prevent overflow */
    enet_uint32          totalReceivedPackets;        /**< total UDP packets received, user should reset to 0 as needed to prevent overflow */
    ENetInterceptCallback intercept;                  /**< callback the user can set to intercept received raw UDP packets */
+   ENetAcknowledgeCallback acknowledge;              /**< callback the user can set to be notified when peers acknowledge reliable packets */
+   ENetAbandonCallback  abandon;                     /**< callback the user can set to be notified when reliable packets are abandoned, see ENetPacket::retransmitLimit */
+   void *               impairment;                  /**< emulated link conditions for received datagrams, see enet_host_impair() */
+   ENetTraceCallback    trace;                       /**< callback receiving events from tracing points, see enet_host_trace() */
+   void *               traceContext;
    size_t               connectedPeers;
    size_t               bandwidthLimitedPeers;
    size_t               duplicatePeers;              /**< optional number of allowed peers from duplicate IPs, defaults to ENET_PROTOCOL_MAXIMUM_PEER_ID */
    size_t               maximumPacketSize;           /**< the maximum allowable packet size that may be sent or received on a peer */
    size_t               maximumWaitingData;          /**< the maximum aggregate amount of buffer space a peer may use waiting for packets to be delivered */
+   enet_uint32          protocolFeatures;            /**< protocol extensions offered to peers when connecting, see ENetProtocolFeature */
+   ENetCompressionStatistics compressionStatistics;  /**< compression statistics totaled over all peers */
+   ENetHistograms       histograms;                  /**< latency distributions totaled over all peers */
+   ENetHostCounters     counters;                    /**< monotonic traffic and drop counters */
 } ENetHost;
 
+/** A snapshot of the statistics of a host.
+
+    @sa enet_host_get_stats()
+ */
+typedef struct _ENetHostStatistics
+{
+   ENetHistograms histograms;
+   enet_uint32   totalSentData;
+   enet_uint32   totalSentPackets;
+   enet_uint32   totalReceivedData;
+   enet_uint32   totalReceivedPackets;
+   size_t        connectedPeers;
+   ENetCompressionStatistics compressionStatistics;
+   ENetHostCounters counters;
+} ENetHostStatistics;
+
 /**
  * An ENet event type, as specified in @ref ENetEvent.
  */
@@ -491,6 +877,11 @@ ENET_API enet_uint32 enet_time_get (void);
   Sets the current wall-time in milliseconds.
   */
 ENET_API void enet_time_set (enet_uint32);
+/**
+  Returns a time in microseconds from an arbitrary origin that wraps around, only suitable
+  for measuring short intervals.
+  */
+ENET_API enet_uint32 enet_time_get_microseconds (void);
 
 /** @defgroup socket ENet socket functions
     @{
@@ -572,26 +963,56 @@ ENET_API void       enet_host_flush (ENetHost *);
 ENET_API void       enet_host_broadcast (ENetHost *, enet_uint8, ENetPacket *);
 ENET_API void       enet_host_compress (ENetHost *, const ENetCompressor *);
 ENET_API int        enet_host_compress_with_range_coder (ENetHost * host);
+ENET_API int        enet_host_compress_with_fast_lz (ENetHost * host);
+ENET_API void       enet_host_compress_history (ENetHost *, int);
+ENET_API void       enet_host_acknowledge_ranges (ENetHost *, int);
+ENET_API void       enet_host_parity_fragments (ENetHost *, int);
+ENET_API void       enet_host_abandon_packets (ENetHost *, int);
+ENET_API int        enet_host_mtu (ENetHost *, enet_uint32);
+ENET_API int        enet_host_discover_mtu (ENetHost *, enet_uint32);
+ENET_API void       enet_host_congestion_control (ENetHost *, const ENetCongestionControl *);
+ENET_API void       enet_host_congestion_control_with_bbr (ENetHost *);
+ENET_API int        enet_host_impair (ENetHost *, const ENetImpairment *);
+ENET_API void       enet_host_get_stats (const ENetHost *, ENetHostStatistics *);
+ENET_API void       enet_host_trace (ENetHost *, ENetTraceCallback, void *);
+ENET_API void ENET_CALLBACK enet_trace_ring_write (ENetHost *, const ENetTraceRecord *, void *);
+extern   void       enet_host_emit_trace (ENetHost *, ENetTraceEvent, enet_uint16, enet_uint32, enet_uint32, enet_uint32);
 ENET_API void       enet_host_channel_limit (ENetHost *, size_t);
 ENET_API void       enet_host_bandwidth_limit (ENetHost *, enet_uint32, enet_uint32);
 extern   void       enet_host_bandwidth_throttle (ENetHost *);
 extern  enet_uint32 enet_host_random_seed (void);
 extern  enet_uint32 enet_host_random (ENetHost *);
+ENET_API enet_uint32 enet_histogram_percentile (const ENetHistogram *, enet_uint32);
+extern   void       enet_histogram_add (ENetHistogram *, enet_uint32);
+extern   int        enet_host_impairment_pending (ENetHost *, enet_uint32 *);
+extern   int        enet_host_impairment_release (ENetHost *);
 
 ENET_API int                 enet_peer_send (ENetPeer *, enet_uint8, ENetPacket *);
 ENET_API ENetPacket *        enet_peer_receive (ENetPeer *, enet_uint8 * channelID);
 ENET_API void                enet_peer_ping (ENetPeer *);
 ENET_API void                enet_peer_ping_interval (ENetPeer *, enet_uint32);
+ENET_API void                enet_peer_delay_acknowledgements (ENetPeer *, enet_uint32, enet_uint32);
 ENET_API void                enet_peer_timeout (ENetPeer *, enet_uint32, enet_uint32, enet_uint32);
 ENET_API void                enet_peer_reset (ENetPeer *);
 ENET_API void                enet_peer_disconnect (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_disconnect_now (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_disconnect_later (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_throttle_configure (ENetPeer *, enet_uint32, enet_uint32, enet_uint32);
+ENET_API int                 enet_peer_channel_configure (ENetPeer *, enet_uint8, enet_uint32);
+ENET_API int                 enet_peer_parity_configure (ENetPeer *, enet_uint8, enet_uint32);
+ENET_API int                 enet_peer_priority_configure (ENetPeer *, enet_uint8, enet_uint32, enet_uint32);
+ENET_API int                 enet_peer_snapshot_configure (ENetPeer *, enet_uint8, size_t);
+ENET_API int                 enet_peer_send_snapshot (ENetPeer *, enet_uint8, const void *, size_t);
+ENET_API void                enet_peer_get_stats (const ENetPeer *, ENetPeerStatistics *);
 extern int                   enet_peer_throttle (ENetPeer *, enet_uint32);
+extern void                  enet_peer_congestion_create (ENetPeer *);
+extern void                  enet_peer_congestion_destroy (ENetPeer *);
+extern enet_uint32           enet_peer_congestion_window (const ENetPeer *);
 extern void                  enet_peer_reset_queues (ENetPeer *);
 extern int                   enet_peer_has_outgoing_commands (ENetPeer *);
 extern void                  enet_peer_setup_outgoing_command (ENetPeer *, ENetOutgoingCommand *);
+extern void                  enet_peer_insert_outgoing_command (ENetList *, ENetOutgoingCommand *);
+extern int                   enet_peer_release_fragment (ENetOutgoingCommand *);
 extern ENetOutgoingCommand * enet_peer_queue_outgoing_command (ENetPeer *, const ENetProtocol *, ENetPacket *, enet_uint32, enet_uint16);
 extern ENetIncomingCommand * enet_peer_queue_incoming_command (ENetPeer *, const ENetProtocol *, const void *, size_t, enet_uint32, enet_uint32);
 extern ENetAcknowledgement * enet_peer_queue_acknowledgement (ENetPeer *, const ENetProtocol *, enet_uint16);
@@ -604,6 +1025,16 @@ ENET_API void * enet_range_coder_create (void);
 ENET_API void   enet_range_coder_destroy (void *);
 ENET_API size_t enet_range_coder_compress (void *, const ENetBuffer *, size_t, size_t, enet_uint8 *, size_t);
 ENET_API size_t enet_range_coder_decompress (void *, const enet_uint8 *, size_t, enet_uint8 *, size_t);
+ENET_API int    enet_range_coder_train (void *, const ENetBuffer *, size_t);
+ENET_API size_t enet_range_coder_save_model (void *, enet_uint8 *, size_t);
+ENET_API int    enet_range_coder_load_model (void *, const enet_uint8 *, size_t);
+
+ENET_API void * enet_fast_lz_create (void);
+ENET_API void   enet_fast_lz_destroy (void *);
+ENET_API size_t enet_fast_lz_compress (void *, const ENetBuffer *, size_t, size_t, enet_uint8 *, size_t);
+ENET_API size_t enet_fast_lz_decompress (void *, const enet_uint8 *, size_t, enet_uint8 *, size_t);
+ENET_API size_t enet_fast_lz_compress_with_dictionary (void *, const enet_uint8 *, size_t, const ENetBuffer *, size_t, size_t, enet_uint8 *, size_t);
+ENET_API size_t enet_fast_lz_decompress_with_dictionary (void *, const enet_uint8 *, size_t, const enet_uint8 *, size_t, enet_uint8 *, size_t);
    
 extern size_t enet_protocol_command_size (enet_uint8);
 
@@ -11,13 +11,15 @@ enum
 {
    ENET_PROTOCOL_MINIMUM_MTU             = 576,
    ENET_PROTOCOL_MAXIMUM_MTU             = 4096,
+   ENET_PROTOCOL_MAXIMUM_JUMBO_MTU       = 65000,
    ENET_PROTOCOL_MAXIMUM_PACKET_COMMANDS = 32,
    ENET_PROTOCOL_MINIMUM_WINDOW_SIZE     = 4096,
    ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE     = 65536,
    ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT   = 1,
    ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT   = 255,
    ENET_PROTOCOL_MAXIMUM_PEER_ID         = 0xFFF,
-   ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT  = 1024 * 1024
+   ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT  = 1024 * 1024,
+   ENET_PROTOCOL_COMPRESSION_HISTORY_STORED = 0xFF
 };
 
 typedef enum _ENetProtocolCommand
@@ -35,7 +37,10 @@ typedef enum _ENetProtocolCommand
    ENET_PROTOCOL_COMMAND_BANDWIDTH_LIMIT    = 10,
    ENET_PROTOCOL_COMMAND_THROTTLE_CONFIGURE = 11,
    ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT = 12,
-   ENET_PROTOCOL_COMMAND_COUNT              = 13,
+   ENET_PROTOCOL_COMMAND_ACKNOWLEDGE_RANGE  = 13,
+   ENET_PROTOCOL_COMMAND_SEND_PARITY_FRAGMENT = 14,
+   ENET_PROTOCOL_COMMAND_SKIP               = 15,
+   ENET_PROTOCOL_COMMAND_COUNT              = 16,
 
    ENET_PROTOCOL_COMMAND_MASK               = 0x0F
 } ENetProtocolCommand;
@@ -53,6 +58,21 @@ typedef enum _ENetProtocolFlag
    ENET_PROTOCOL_HEADER_SESSION_SHIFT   = 12
 } ENetProtocolFlag;
 
+/** Optional protocol extensions, offered in the high bits of the mtu field of the connect
+    and verify connect commands. Peers that predate them clamp the mtu and ignore the bits,
+    and an extension is only used if both sides offered it.
+ */
+typedef enum _ENetProtocolFeature
+{
+   ENET_PROTOCOL_FEATURE_COMPRESSION_HISTORY = (1 << 24),
+   ENET_PROTOCOL_FEATURE_ACKNOWLEDGE_RANGE   = (1 << 25),
+   ENET_PROTOCOL_FEATURE_PARITY_FRAGMENT     = (1 << 26),
+   ENET_PROTOCOL_FEATURE_SKIP                = (1 << 27),
+
+   ENET_PROTOCOL_FEATURE_MASK = 0x7F000000,
+   ENET_PROTOCOL_MTU_MASK     = 0x00FFFFFF
+} ENetProtocolFeature;
+
 #ifdef _MSC_VER
 #pragma pack(push, 1)
 #define ENET_PACKED
@@ -82,6 +102,21 @@ typedef struct _ENetProtocolAcknowledge
    enet_uint16 receivedSentTime;
 } ENET_PACKED ENetProtocolAcknowledge;
 
+/** Acknowledges the rangeLength reliable commands of a channel starting at the reliable sequence
+    number of the header, and those of the 32 sequence numbers after the first one missing whose
+    bit is set in receivedMask, lowest bit first. receivedSentTime is that of the earliest datagram
+    that carried one of them, and acknowledgementDelay the milliseconds the acknowledgement was
+    held back after that datagram arrived, which the sender discounts from the round trip time.
+ */
+typedef struct _ENetProtocolAcknowledgeRange
+{
+   ENetProtocolCommandHeader header;
+   enet_uint16 receivedSentTime;
+   enet_uint16 rangeLength;
+   enet_uint32 receivedMask;
+   enet_uint16 acknowledgementDelay;
+} ENET_PACKED ENetProtocolAcknowledgeRange;
+
 typedef struct _ENetProtocolConnect
 {
    ENetProtocolCommandHeader header;
@@ -174,10 +209,40 @@ typedef struct _ENetProtocolSendFragment
    enet_uint32 fragmentOffset;
 } ENET_PACKED ENetProtocolSendFragment;
 
+/** Carries the bytewise exclusive or of groupLength consecutive fragments of an unreliable
+    fragmented packet, starting at fragment groupNumber, each zero-padded to dataLength. The
+    other fields identify the packet as for ENetProtocolSendFragment.
+ */
+typedef struct _ENetProtocolSendParityFragment
+{
+   ENetProtocolCommandHeader header;
+   enet_uint16 startSequenceNumber;
+   enet_uint16 dataLength;
+   enet_uint32 fragmentCount;
+   enet_uint32 groupNumber;
+   enet_uint32 totalLength;
+   enet_uint32 groupLength;
+} ENET_PACKED ENetProtocolSendParityFragment;
+
+/** Takes the place of a reliable command whose packet the sender abandoned, so the channel
+    moves past it without delivering the packet. The command bears the reliable sequence number
+    of the command it replaces, and the other fields identify the fragment it replaces as for
+    ENetProtocolSendFragment, or fragment 0 of 1 starting at that same sequence number for an
+    unfragmented packet.
+ */
+typedef struct _ENetProtocolSkip
+{
+   ENetProtocolCommandHeader header;
+   enet_uint16 startSequenceNumber;
+   enet_uint32 fragmentCount;
+   enet_uint32 fragmentNumber;
+} ENET_PACKED ENetProtocolSkip;
+
 typedef union _ENetProtocol
 {
    ENetProtocolCommandHeader header;
    ENetProtocolAcknowledge acknowledge;
+   ENetProtocolAcknowledgeRange acknowledgeRange;
    ENetProtocolConnect connect;
    ENetProtocolVerifyConnect verifyConnect;
    ENetProtocolDisconnect disconnect;
@@ -186,6 +251,8 @@ typedef union _ENetProtocol
    ENetProtocolSendUnreliable sendUnreliable;
    ENetProtocolSendUnsequenced sendUnsequenced;
    ENetProtocolSendFragment sendFragment;
+   ENetProtocolSendParityFragment sendParityFragment;
+   ENetProtocolSkip skip;
    ENetProtocolBandwidthLimit bandwidthLimit;
    ENetProtocolThrottleConfigure throttleConfigure;
 } ENET_PACKED ENetProtocol;
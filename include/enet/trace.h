@@ -0,0 +1,35 @@
+/**
+ @file  trace.h
+ @brief ENet tracing points
+*/
+#ifndef __ENET_TRACE_H__
+#define __ENET_TRACE_H__
+
+/* Every tracing point is both a USDT probe in the "enet" provider, where sys/sdt.h is available,
+   and a call to the trace callback of the host if one is set. A USDT probe compiles to a single
+   nop until a tracer attaches to it, and the callback costs one untaken branch when unset, so the
+   points may stay in hot paths. Defining ENET_NO_TRACE compiles both away entirely.
+
+   Each point passes the host, the incoming peer ID of the peer concerned or 0xFFFF for none, and
+   three event-specific arguments, documented with ENetTraceEvent. */
+
+#if defined(HAS_SYS_SDT_H) && ! defined(ENET_NO_TRACE)
+#include <sys/sdt.h>
+#define ENET_TRACE_PROBE(name, host, peerID, a, b, c) DTRACE_PROBE5 (enet, name, host, peerID, a, b, c)
+#else
+#define ENET_TRACE_PROBE(name, host, peerID, a, b, c)
+#endif
+
+#ifdef ENET_NO_TRACE
+#define ENET_TRACE(host, event, name, peerID, a, b, c) do { } while (0)
+#else
+#define ENET_TRACE(host, event, name, peerID, a, b, c) \
+    do { \
+        ENET_TRACE_PROBE (name, host, peerID, a, b, c); \
+        if ((host) -> trace != NULL) \
+          enet_host_emit_trace ((host), (event), (peerID), (enet_uint32) (a), (enet_uint32) (b), (enet_uint32) (c)); \
+    } while (0)
+#endif
+
+#endif /* __ENET_TRACE_H__ */
+
@@ -46,6 +46,8 @@ enet_packet_create (const void * data, size_t dataLength, enet_uint32 flags)
     packet -> dataLength = dataLength;
     packet -> freeCallback = NULL;
     packet -> userData = NULL;
+    packet -> lifetime = 0;
+    packet -> retransmitLimit = 0;
 
     return packet;
 }
@@ -6,6 +6,7 @@
 #define ENET_BUILDING_LIB 1
 #include "enet/utility.h"
 #include "enet/enet.h"
+#include "enet/trace.h"
 
 /** @defgroup peer ENet peer functions 
     @{
@@ -59,6 +60,161 @@ enet_peer_throttle_configure (ENetPeer * peer, enet_uint32 interval, enet_uint32
     enet_peer_queue_outgoing_command (peer, & command, NULL, 0, 0);
 }
 
+/** Configures local options for a channel of a peer. The options only affect how this host sends
+    and receives on the channel and need not be agreed upon with the foreign host. Channels are
+    allocated when the connection is initiated, so the options must be set again after each new
+    connection.
+
+    @param peer peer whose channel to configure
+    @param channelID channel to configure
+    @param flags bitwise-or of ENetChannelFlag options for the channel
+    @retval 0 on success
+    @retval < 0 if the channel does not exist or the options could not be applied
+*/
+int
+enet_peer_channel_configure (ENetPeer * peer, enet_uint8 channelID, enet_uint32 flags)
+{
+    ENetChannel * channel;
+
+    if (channelID >= peer -> channelCount)
+      return -1;
+
+    channel = & peer -> channels [channelID];
+
+    /* the window outlives the flag so packets already delivered ahead are still passed over in order */
+    if ((flags & ENET_CHANNEL_FLAG_UNORDERED) && channel -> unorderedWindow == NULL)
+    {
+        channel -> unorderedWindow = (enet_uint32 *) enet_malloc (ENET_PEER_UNORDERED_WINDOW_SIZE / 32 * sizeof (enet_uint32));
+        if (channel -> unorderedWindow == NULL)
+          return -1;
+
+        memset (channel -> unorderedWindow, 0, ENET_PEER_UNORDERED_WINDOW_SIZE / 32 * sizeof (enet_uint32));
+    }
+
+    channel -> flags = flags;
+
+    return 0;
+}
+
+/** Adds forward error correction to the unreliable fragmented packets sent on a channel of a
+    peer. After every group of the given number of fragments of a packet sent with
+    ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT, a parity fragment follows, from which the peer rebuilds
+    any single fragment of the group that was lost instead of discarding the whole packet. Smaller
+    groups survive more loss at the cost of more redundancy: a group of 4 adds a quarter to the
+    data sent. Parity fragments are only sent if both hosts enabled enet_host_parity_fragments(),
+    and like other channel options, this must be set again after each new connection.
+
+    @param peer peer whose channel to configure
+    @param channelID channel to configure
+    @param groupLength number of fragments covered by each parity fragment, or 0 to send none
+    @retval 0 on success
+    @retval < 0 if the channel does not exist
+*/
+int
+enet_peer_parity_configure (ENetPeer * peer, enet_uint8 channelID, enet_uint32 groupLength)
+{
+    if (channelID >= peer -> channelCount)
+      return -1;
+
+    peer -> channels [channelID].parityGroupLength = groupLength;
+
+    return 0;
+}
+
+/* Moves the commands of a channel already in a list to the channel's new priority, keeping their
+   start times and so their order among each other. Outgoing queues are sorted again, while the
+   list of sent commands stays in the order they were sent. */
+static void
+enet_peer_reprioritize_outgoing_commands (ENetList * list, enet_uint8 channelID, enet_uint64 priorityOrder, int sorted)
+{
+    const enet_uint64 timeMask = ((enet_uint64) 1 << ENET_PEER_SCHEDULE_TIME_BITS) - 1;
+    ENetListIterator currentCommand;
+    ENetList channelCommands;
+
+    enet_list_clear (& channelCommands);
+
+    for (currentCommand = enet_list_begin (list);
+         currentCommand != enet_list_end (list);)
+    {
+       ENetOutgoingCommand * outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+
+       currentCommand = enet_list_next (currentCommand);
+
+       if (outgoingCommand -> command.header.channelID != channelID)
+         continue;
+
+       outgoingCommand -> queueOrder = (outgoingCommand -> queueOrder & timeMask) | priorityOrder;
+
+       if (sorted)
+         enet_list_insert (enet_list_end (& channelCommands), enet_list_remove (& outgoingCommand -> outgoingCommandList));
+    }
+
+    while (! enet_list_empty (& channelCommands))
+      enet_peer_insert_outgoing_command (list, (ENetOutgoingCommand *) enet_list_remove (enet_list_begin (& channelCommands)));
+}
+
+/** Sets how a channel of a peer shares the bandwidth with the other channels of the peer. Data
+    queued on channels of higher priority is sent ahead of any data queued on channels of lower
+    priority, while channels of the same priority take turns in proportion to their weights, so a
+    bulk transfer on one channel does not hold up messages queued after it on another. Data already
+    queued on the channel moves to its new priority in the order it was queued. All channels
+    start out with priority 0 and weight ENET_CHANNEL_DEFAULT_WEIGHT, and like other channel
+    options, this must be set again after each new connection.
+
+    @param peer peer whose channel to configure
+    @param channelID channel to configure
+    @param priority priority of the channel, from 0 up to 255
+    @param weight share of the bandwidth left to channels of the same priority, from 1 up to 65535
+    @retval 0 on success
+    @retval < 0 if the channel does not exist or the arguments are out of range
+*/
+int
+enet_peer_priority_configure (ENetPeer * peer, enet_uint8 channelID, enet_uint32 priority, enet_uint32 weight)
+{
+    ENetChannel * channel;
+
+    if (channelID >= peer -> channelCount ||
+        priority > 255 ||
+        weight < 1 || weight > 65535)
+      return -1;
+
+    channel = & peer -> channels [channelID];
+    if (channel -> priority != priority)
+    {
+        enet_uint64 priorityOrder = (enet_uint64) (256 - priority) << ENET_PEER_SCHEDULE_TIME_BITS;
+
+        enet_peer_reprioritize_outgoing_commands (& peer -> sentReliableCommands, channelID, priorityOrder, 0);
+        enet_peer_reprioritize_outgoing_commands (& peer -> outgoingSendReliableCommands, channelID, priorityOrder, 1);
+        enet_peer_reprioritize_outgoing_commands (& peer -> outgoingCommands, channelID, priorityOrder, 1);
+    }
+    channel -> priority = priority;
+    channel -> weight = weight;
+
+    return 0;
+}
+
+/** Takes a snapshot of the statistics of a peer, including the distributions of latencies
+    measured on it since it last connected.
+    @param peer peer to query
+    @param statistics where to store the statistics
+*/
+void
+enet_peer_get_stats (const ENetPeer * peer, ENetPeerStatistics * statistics)
+{
+    statistics -> histograms = peer -> histograms;
+    statistics -> roundTripTime = peer -> roundTripTime;
+    statistics -> roundTripTimeVariance = peer -> roundTripTimeVariance;
+    statistics -> packetLoss = peer -> packetLoss;
+    statistics -> packetLossVariance = peer -> packetLossVariance;
+    statistics -> packetThrottle = peer -> packetThrottle;
+    statistics -> reliableDataInTransit = peer -> reliableDataInTransit;
+    statistics -> totalWaitingData = peer -> totalWaitingData;
+    statistics -> compressionStatistics = peer -> compressionStatistics;
+    statistics -> congestionWindow = enet_peer_congestion_window (peer);
+    statistics -> pacingRate = peer -> congestionState != NULL && peer -> host -> congestionControl.pacingRate != NULL ?
+        peer -> host -> congestionControl.pacingRate (peer -> congestionState, peer) : 0;
+}
+
 int
 enet_peer_throttle (ENetPeer * peer, enet_uint32 rtt)
 {
@@ -90,33 +246,87 @@ enet_peer_throttle (ENetPeer * peer, enet_uint32 rtt)
     return 0;
 }
 
-/** Queues a packet to be sent.
+void
+enet_peer_congestion_create (ENetPeer * peer)
+{
+    ENetHost * host = peer -> host;
 
-    On success, ENet will assume ownership of the packet, and so enet_packet_destroy
-    should not be called on it thereafter. On failure, the caller still must destroy
-    the packet on its own as ENet has not queued the packet. The caller can also
-    check the packet's referenceCount field after sending to check if ENet queued
-    the packet and thus incremented the referenceCount.
+    if (host -> congestionControl.context == NULL || peer -> congestionState != NULL)
+      return;
 
-    @param peer destination for the packet
-    @param channelID channel on which to send
-    @param packet packet to send
-    @retval 0 on success
-    @retval < 0 on failure
-*/
-int
-enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
+    peer -> congestionState = host -> congestionControl.create (host -> congestionControl.context, peer);
+}
+
+void
+enet_peer_congestion_destroy (ENetPeer * peer)
+{
+    ENetHost * host = peer -> host;
+
+    if (peer -> congestionState == NULL)
+      return;
+
+    host -> congestionControl.destroy (host -> congestionControl.context, peer -> congestionState);
+
+    peer -> congestionState = NULL;
+}
+
+enet_uint32
+enet_peer_congestion_window (const ENetPeer * peer)
+{
+    if (peer -> congestionState != NULL)
+      return peer -> host -> congestionControl.window (peer -> congestionState, peer);
+
+    return (peer -> packetThrottle * peer -> windowSize) / ENET_PEER_PACKET_THROTTLE_SCALE;
+}
+
+/* Drops the unsent unreliable packet that a newer one on a channel with ENET_CHANNEL_FLAG_SUPERSEDE
+   replaced, along with the rest of its fragments and their parity. */
+static void
+enet_peer_supersede_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoingCommand)
+{
+    ENetListIterator currentCommand = & outgoingCommand -> outgoingCommandList;
+    enet_uint16 reliableSequenceNumber = outgoingCommand -> reliableSequenceNumber,
+                unreliableSequenceNumber = outgoingCommand -> unreliableSequenceNumber;
+    enet_uint8 channelID = outgoingCommand -> command.header.channelID;
+
+    do
+    {
+       outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+       currentCommand = enet_list_next (currentCommand);
+
+       ++ peer -> host -> counters.drops [ENET_DROP_REASON_SUPERSEDED];
+
+       ENET_TRACE (peer -> host, ENET_TRACE_EVENT_COMMAND_DROPPED, command_dropped, peer -> incomingPeerID,
+                   outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK, outgoingCommand -> reliableSequenceNumber, outgoingCommand -> unreliableSequenceNumber);
+
+       -- outgoingCommand -> packet -> referenceCount;
+
+       if (outgoingCommand -> packet -> referenceCount == 0)
+         enet_packet_destroy (outgoingCommand -> packet);
+
+       enet_list_remove (& outgoingCommand -> outgoingCommandList);
+       enet_free (outgoingCommand);
+
+       if (currentCommand == enet_list_end (& peer -> outgoingCommands))
+         break;
+
+       outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+    }
+    while (outgoingCommand -> command.header.channelID == channelID &&
+           outgoingCommand -> reliableSequenceNumber == reliableSequenceNumber &&
+           outgoingCommand -> unreliableSequenceNumber == unreliableSequenceNumber &&
+           (outgoingCommand -> fragmentOffset != 0 ||
+             (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_SEND_PARITY_FRAGMENT));
+}
+
+/* Queues a packet on a channel, as one command or as fragments. */
+static int
+enet_peer_queue_packet (ENetPeer * peer, ENetChannel * channel, enet_uint8 channelID, ENetPacket * packet)
 {
-   ENetChannel * channel;
    ENetProtocol command;
+   ENetOutgoingCommand * outgoingCommand;
    size_t fragmentLength;
 
-   if (peer -> state != ENET_PEER_STATE_CONNECTED ||
-       channelID >= peer -> channelCount ||
-       packet -> dataLength > peer -> host -> maximumPacketSize)
-     return -1;
-
-   channel = & peer -> channels [channelID];
    fragmentLength = peer -> mtu - sizeof (ENetProtocolHeader) - sizeof (ENetProtocolSendFragment);
    if (peer -> host -> checksum != NULL)
      fragmentLength -= sizeof(enet_uint32);
@@ -125,11 +335,17 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
    {
       enet_uint32 fragmentCount = (packet -> dataLength + fragmentLength - 1) / fragmentLength,
              fragmentNumber,
-             fragmentOffset;
+             fragmentOffset,
+             groupNumber,
+             parityGroupLength = 0;
+      size_t groupFragmentLength, parityOffset;
+      ENetPacket * parityPacket = NULL;
+      enet_uint8 * parity;
       enet_uint8 commandNumber;
       enet_uint16 startSequenceNumber; 
       ENetList fragments;
       ENetOutgoingCommand * fragment;
+      enet_uint32 * unacknowledgedFragments = NULL;
 
       if (fragmentCount > ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT)
         return -1;
@@ -146,6 +362,29 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
          startSequenceNumber = ENET_HOST_TO_NET_16 (channel -> outgoingReliableSequenceNumber + 1);
       }
         
+      if (commandNumber == ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT &&
+          channel -> parityGroupLength > 0 &&
+          (peer -> protocolFeatures & ENET_PROTOCOL_FEATURE_PARITY_FRAGMENT))
+      {
+         parityGroupLength = channel -> parityGroupLength;
+         parityPacket = enet_packet_create (NULL, ((fragmentCount + parityGroupLength - 1) / parityGroupLength) * fragmentLength, 0);
+         if (parityPacket == NULL)
+           return -1;
+
+         memset (parityPacket -> data, 0, parityPacket -> dataLength);
+      }
+
+      if (commandNumber != ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT)
+      {
+         unacknowledgedFragments = (enet_uint32 *) enet_malloc (sizeof (enet_uint32));
+         if (unacknowledgedFragments == NULL)
+           return -1;
+
+         * unacknowledgedFragments = fragmentCount;
+      }
+
+      groupFragmentLength = fragmentLength;
+
       enet_list_clear (& fragments);
 
       for (fragmentNumber = 0,
@@ -159,20 +398,12 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
 
          fragment = (ENetOutgoingCommand *) enet_malloc (sizeof (ENetOutgoingCommand));
          if (fragment == NULL)
-         {
-            while (! enet_list_empty (& fragments))
-            {
-               fragment = (ENetOutgoingCommand *) enet_list_remove (enet_list_begin (& fragments));
-               
-               enet_free (fragment);
-            }
-            
-            return -1;
-         }
+           goto fragmentError;
          
          fragment -> fragmentOffset = fragmentOffset;
          fragment -> fragmentLength = fragmentLength;
          fragment -> packet = packet;
+         fragment -> unacknowledgedFragments = unacknowledgedFragments;
          fragment -> command.header.command = commandNumber;
          fragment -> command.header.channelID = channelID;
          fragment -> command.sendFragment.startSequenceNumber = startSequenceNumber;
@@ -183,10 +414,46 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
          fragment -> command.sendFragment.fragmentOffset = ENET_NET_TO_HOST_32 (fragmentOffset);
         
          enet_list_insert (enet_list_end (& fragments), fragment);
+
+         if (parityPacket == NULL)
+           continue;
+
+         groupNumber = fragmentNumber - fragmentNumber % parityGroupLength;
+         parity = parityPacket -> data + (groupNumber / parityGroupLength) * groupFragmentLength;
+         for (parityOffset = 0; parityOffset < fragmentLength; ++ parityOffset)
+           parity [parityOffset] ^= packet -> data [fragmentOffset + parityOffset];
+
+         /* the parity of a group follows its last fragment, so it arrives after the fragments it can rebuild */
+         if (fragmentNumber - groupNumber + 1 < parityGroupLength && fragmentNumber + 1 < fragmentCount)
+           continue;
+
+         fragment = (ENetOutgoingCommand *) enet_malloc (sizeof (ENetOutgoingCommand));
+         if (fragment == NULL)
+           goto fragmentError;
+
+         fragment -> fragmentOffset = (groupNumber / parityGroupLength) * groupFragmentLength;
+         fragment -> fragmentLength = groupNumber == fragmentNumber ? fragmentLength : groupFragmentLength;
+         fragment -> packet = parityPacket;
+         fragment -> unacknowledgedFragments = NULL;
+         fragment -> command.header.command = ENET_PROTOCOL_COMMAND_SEND_PARITY_FRAGMENT;
+         fragment -> command.header.channelID = channelID;
+         fragment -> command.sendParityFragment.startSequenceNumber = startSequenceNumber;
+         fragment -> command.sendParityFragment.dataLength = ENET_HOST_TO_NET_16 (fragment -> fragmentLength);
+         fragment -> command.sendParityFragment.fragmentCount = ENET_HOST_TO_NET_32 (fragmentCount);
+         fragment -> command.sendParityFragment.groupNumber = ENET_HOST_TO_NET_32 (groupNumber);
+         fragment -> command.sendParityFragment.totalLength = ENET_HOST_TO_NET_32 (packet -> dataLength);
+         fragment -> command.sendParityFragment.groupLength = ENET_HOST_TO_NET_32 (fragmentNumber - groupNumber + 1);
+
+         enet_list_insert (enet_list_end (& fragments), fragment);
+
+         ++ parityPacket -> referenceCount;
       }
 
       packet -> referenceCount += fragmentNumber;
 
+      if (commandNumber == ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT && (channel -> flags & ENET_CHANNEL_FLAG_SUPERSEDE))
+        channel -> supersedableCommand = (ENetOutgoingCommand *) enet_list_front (& fragments);
+
       while (! enet_list_empty (& fragments))
       {
          fragment = (ENetOutgoingCommand *) enet_list_remove (enet_list_begin (& fragments));
@@ -195,6 +462,22 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
       }
 
       return 0;
+
+   fragmentError:
+      while (! enet_list_empty (& fragments))
+      {
+         fragment = (ENetOutgoingCommand *) enet_list_remove (enet_list_begin (& fragments));
+
+         enet_free (fragment);
+      }
+
+      if (parityPacket != NULL)
+        enet_packet_destroy (parityPacket);
+
+      if (unacknowledgedFragments != NULL)
+        enet_free (unacknowledgedFragments);
+
+      return -1;
    }
 
    command.header.channelID = channelID;
@@ -216,12 +499,504 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
       command.sendUnreliable.dataLength = ENET_HOST_TO_NET_16 (packet -> dataLength);
    }
 
-   if (enet_peer_queue_outgoing_command (peer, & command, packet, 0, packet -> dataLength) == NULL)
+   outgoingCommand = enet_peer_queue_outgoing_command (peer, & command, packet, 0, packet -> dataLength);
+   if (outgoingCommand == NULL)
      return -1;
 
+   if (! (command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE) && (channel -> flags & ENET_CHANNEL_FLAG_SUPERSEDE))
+     channel -> supersedableCommand = outgoingCommand;
+
+   return 0;
+}
+
+/** Queues a packet to be sent.
+
+    On success, ENet will assume ownership of the packet, and so enet_packet_destroy
+    should not be called on it thereafter. On failure, the caller still must destroy
+    the packet on its own as ENet has not queued the packet. The caller can also
+    check the packet's referenceCount field after sending to check if ENet queued
+    the packet and thus incremented the referenceCount.
+
+    @param peer destination for the packet
+    @param channelID channel on which to send
+    @param packet packet to send
+    @retval 0 on success
+    @retval < 0 on failure
+*/
+int
+enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
+{
+   ENetChannel * channel;
+   ENetOutgoingCommand * supersededCommand = NULL;
+   enet_uint64 scheduleFinish = 0;
+
+   if (peer -> state != ENET_PEER_STATE_CONNECTED ||
+       channelID >= peer -> channelCount ||
+       packet -> dataLength > peer -> host -> maximumPacketSize)
+     return -1;
+
+   channel = & peer -> channels [channelID];
+   if (channel -> supersedableCommand != NULL &&
+       (channel -> flags & ENET_CHANNEL_FLAG_SUPERSEDE) &&
+       ! (packet -> flags & ENET_PACKET_FLAG_RELIABLE))
+   {
+      supersededCommand = channel -> supersedableCommand;
+      scheduleFinish = channel -> scheduleFinish;
+
+      /* the newer packet takes the place of the older in the schedule if nothing was queued on the channel after it */
+      if (channel -> scheduleStart == (supersededCommand -> queueOrder & (((enet_uint64) 1 << ENET_PEER_SCHEDULE_TIME_BITS) - 1)))
+        channel -> scheduleFinish = channel -> scheduleStart;
+   }
+
+   /* the older packet is only dropped once the newer one is queued, so a failure leaves the channel as it was */
+   if (enet_peer_queue_packet (peer, channel, channelID, packet) < 0)
+   {
+      if (supersededCommand != NULL)
+        channel -> scheduleFinish = scheduleFinish;
+
+      return -1;
+   }
+
+   if (supersededCommand != NULL)
+   {
+      if (channel -> supersedableCommand == supersededCommand)
+        channel -> supersedableCommand = NULL;
+
+      enet_peer_supersede_outgoing_command (peer, supersededCommand);
+   }
+
    return 0;
 }
 
+enum
+{
+   ENET_SNAPSHOT_FULL            = 0,
+   ENET_SNAPSHOT_DELTA           = 1,
+   ENET_SNAPSHOT_ACKNOWLEDGE     = 2,
+
+   ENET_SNAPSHOT_HEADER_SIZE     = 3,
+   ENET_SNAPSHOT_MINIMUM_MATCH   = 4,
+   ENET_SNAPSHOT_MAXIMUM_BASELINES = 0x8000
+};
+
+/* The delta kernel works a machine word at a time: a word of the snapshot XOR the baseline is
+   zero wherever they match, and the usual zero byte test finds words in which every byte differs. */
+#define ENET_SNAPSHOT_WORD_ONES ((size_t) -1 / 0xFF)
+#define ENET_SNAPSHOT_WORD_HAS_ZERO(word) (((word) - ENET_SNAPSHOT_WORD_ONES) & ~ (word) & (ENET_SNAPSHOT_WORD_ONES << 7))
+
+static void
+enet_peer_destroy_snapshots (ENetSnapshotChannel * snapshots)
+{
+    size_t i;
+
+    for (i = 0; i < 2 * snapshots -> baselineCount; ++ i)
+      enet_free (snapshots -> outgoingBaselines [i].data);
+
+    enet_free (snapshots);
+}
+
+/** Makes a channel of a peer carry state snapshots delta-encoded against the latest snapshot
+    the peer has acknowledged. Snapshots are sent with enet_peer_send_snapshot() and arrive as
+    ordinary receive events holding the full snapshot. Both hosts must configure the channel
+    with the same number of baselines, and the channel must not be used for anything else.
+    Like other channel options, this must be set again after each new connection.
+
+    @param peer peer whose channel to configure
+    @param channelID channel to carry snapshots
+    @param baselineCount number of recent snapshots kept as baselines on each side, or 0 to
+    make the channel an ordinary channel again
+    @retval 0 on success
+    @retval < 0 on failure
+*/
+int
+enet_peer_snapshot_configure (ENetPeer * peer, enet_uint8 channelID, size_t baselineCount)
+{
+    ENetChannel * channel;
+    ENetSnapshotChannel * snapshots = NULL;
+
+    if (channelID >= peer -> channelCount || baselineCount > ENET_SNAPSHOT_MAXIMUM_BASELINES)
+      return -1;
+
+    channel = & peer -> channels [channelID];
+
+    if (baselineCount > 0)
+    {
+        snapshots = (ENetSnapshotChannel *) enet_malloc (sizeof (ENetSnapshotChannel) + 2 * baselineCount * sizeof (ENetSnapshotBaseline));
+        if (snapshots == NULL)
+          return -1;
+
+        snapshots -> baselineCount = baselineCount;
+        snapshots -> outgoingNumber = 0;
+        snapshots -> acknowledgedNumber = 0;
+        snapshots -> acknowledged = 0;
+        snapshots -> outgoingBaselines = (ENetSnapshotBaseline *) & snapshots [1];
+        snapshots -> incomingBaselines = & snapshots -> outgoingBaselines [baselineCount];
+
+        memset (snapshots -> outgoingBaselines, 0, 2 * baselineCount * sizeof (ENetSnapshotBaseline));
+    }
+
+    if (channel -> snapshots != NULL)
+      enet_peer_destroy_snapshots (channel -> snapshots);
+
+    channel -> snapshots = snapshots;
+
+    return 0;
+}
+
+static int
+enet_peer_store_snapshot (ENetSnapshotBaseline * baseline, enet_uint16 number, const enet_uint8 * data, size_t dataLength)
+{
+    if (dataLength > baseline -> dataSize || baseline -> data == NULL)
+    {
+        enet_uint8 * newData = (enet_uint8 *) enet_malloc (dataLength > 0 ? dataLength : 1);
+        if (newData == NULL)
+        {
+            baseline -> valid = 0;
+            return -1;
+        }
+
+        enet_free (baseline -> data);
+        baseline -> data = newData;
+        baseline -> dataSize = dataLength;
+    }
+
+    memcpy (baseline -> data, data, dataLength);
+    baseline -> dataLength = dataLength;
+    baseline -> number = number;
+    baseline -> valid = 1;
+
+    return 0;
+}
+
+static enet_uint8 *
+enet_peer_write_snapshot_length (enet_uint8 * out, enet_uint8 * outEnd, size_t length)
+{
+    do
+    {
+        if (out >= outEnd)
+          return NULL;
+
+        * out ++ = (enet_uint8) ((length & 0x7F) | (length > 0x7F ? 0x80 : 0));
+        length >>= 7;
+    } while (length > 0);
+
+    return out;
+}
+
+static const enet_uint8 *
+enet_peer_read_snapshot_length (const enet_uint8 * in, const enet_uint8 * inEnd, size_t * length)
+{
+    size_t shift = 0;
+
+    * length = 0;
+    for (;;)
+    {
+        if (in >= inEnd || shift >= 8 * sizeof (size_t))
+          return NULL;
+
+        * length |= (size_t) (* in & 0x7F) << shift;
+        shift += 7;
+
+        if (! (* in ++ & 0x80))
+          return in;
+    }
+}
+
+static size_t
+enet_peer_match_snapshot (const enet_uint8 * data, const enet_uint8 * baseline, size_t length)
+{
+    size_t matched = 0;
+
+    for (; matched + sizeof (size_t) <= length; matched += sizeof (size_t))
+    {
+        size_t dataWord, baselineWord;
+
+        memcpy (& dataWord, & data [matched], sizeof (size_t));
+        memcpy (& baselineWord, & baseline [matched], sizeof (size_t));
+        if (dataWord != baselineWord)
+          break;
+    }
+
+    while (matched < length && data [matched] == baseline [matched])
+      ++ matched;
+
+    return matched;
+}
+
+static size_t
+enet_peer_differ_snapshot (const enet_uint8 * data, const enet_uint8 * baseline, size_t length)
+{
+    size_t differed = 0;
+
+    for (; differed + sizeof (size_t) <= length; differed += sizeof (size_t))
+    {
+        size_t dataWord, baselineWord, delta;
+
+        memcpy (& dataWord, & data [differed], sizeof (size_t));
+        memcpy (& baselineWord, & baseline [differed], sizeof (size_t));
+        delta = dataWord ^ baselineWord;
+        if (ENET_SNAPSHOT_WORD_HAS_ZERO (delta))
+          break;
+    }
+
+    while (differed < length && data [differed] != baseline [differed])
+      ++ differed;
+
+    return differed;
+}
+
+/* A delta is a sequence of runs, each giving the number of bytes matching the baseline followed
+   by the number of literal bytes and the literal bytes themselves, which are the snapshot XOR the
+   baseline, or just the snapshot past the end of the baseline. Short matches are folded into the
+   surrounding literal, since the run lengths would cost more than they save. */
+static size_t
+enet_peer_encode_snapshot_delta (const enet_uint8 * data, size_t dataLength, const ENetSnapshotBaseline * baseline, enet_uint8 * outData, size_t outLimit)
+{
+    const enet_uint8 * base = baseline -> data;
+    size_t commonLength = ENET_MIN (dataLength, baseline -> dataLength), position = 0;
+    enet_uint8 * out = outData, * outEnd = outData + outLimit;
+
+    while (position < dataLength)
+    {
+        size_t matchLength = position < commonLength ? enet_peer_match_snapshot (& data [position], & base [position], commonLength - position) : 0,
+               literalStart = position + matchLength,
+               literalEnd = literalStart,
+               i;
+
+        while (literalEnd < commonLength)
+        {
+            size_t nextMatch;
+
+            literalEnd += enet_peer_differ_snapshot (& data [literalEnd], & base [literalEnd], commonLength - literalEnd);
+            if (literalEnd >= commonLength)
+              break;
+
+            nextMatch = enet_peer_match_snapshot (& data [literalEnd], & base [literalEnd], ENET_MIN (commonLength - literalEnd, ENET_SNAPSHOT_MINIMUM_MATCH));
+            if (nextMatch >= ENET_SNAPSHOT_MINIMUM_MATCH || literalEnd + nextMatch >= commonLength)
+              break;
+
+            literalEnd += nextMatch;
+        }
+        if (literalEnd >= commonLength)
+          literalEnd = dataLength;
+
+        out = enet_peer_write_snapshot_length (out, outEnd, matchLength);
+        if (out == NULL)
+          return 0;
+        out = enet_peer_write_snapshot_length (out, outEnd, literalEnd - literalStart);
+        if (out == NULL || (size_t) (outEnd - out) < literalEnd - literalStart)
+          return 0;
+
+        for (i = literalStart; i < literalEnd; ++ i)
+          * out ++ = i < commonLength ? data [i] ^ base [i] : data [i];
+
+        position = literalEnd;
+    }
+
+    return out - outData;
+}
+
+static int
+enet_peer_decode_snapshot_delta (const enet_uint8 * in, const enet_uint8 * inEnd, const ENetSnapshotBaseline * baseline, enet_uint8 * outData, size_t outLength)
+{
+    const enet_uint8 * base = baseline -> data;
+    size_t position = 0;
+
+    while (position < outLength)
+    {
+        size_t matchLength, literalLength, i;
+
+        in = enet_peer_read_snapshot_length (in, inEnd, & matchLength);
+        if (in == NULL)
+          return -1;
+        in = enet_peer_read_snapshot_length (in, inEnd, & literalLength);
+        if (in == NULL ||
+            matchLength > baseline -> dataLength - ENET_MIN (position, baseline -> dataLength) ||
+            matchLength > outLength - position ||
+            literalLength > outLength - position - matchLength ||
+            literalLength > (size_t) (inEnd - in))
+          return -1;
+
+        memcpy (& outData [position], & base [position], matchLength);
+        position += matchLength;
+
+        for (i = 0; i < literalLength; ++ i, ++ position)
+          outData [position] = position < baseline -> dataLength ? * in ++ ^ base [position] : * in ++;
+
+        if (matchLength == 0 && literalLength == 0)
+          return -1;
+    }
+
+    return in == inEnd ? 0 : -1;
+}
+
+/** Queues a snapshot to be sent on a snapshot channel. The snapshot is sent unreliably as a delta
+    against the latest snapshot the peer has acknowledged while that is still held as a baseline,
+    and in full otherwise.
+
+    @param peer destination for the snapshot
+    @param channelID snapshot channel on which to send, see enet_peer_snapshot_configure()
+    @param data snapshot contents, which are copied
+    @param dataLength size of the snapshot
+    @retval 0 on success
+    @retval < 0 on failure
+*/
+int
+enet_peer_send_snapshot (ENetPeer * peer, enet_uint8 channelID, const void * data, size_t dataLength)
+{
+    ENetSnapshotChannel * snapshots;
+    ENetSnapshotBaseline * baseline = NULL;
+    ENetPacket * packet;
+    enet_uint16 number;
+    size_t packetLength = 0;
+
+    if (channelID >= peer -> channelCount || peer -> channels [channelID].snapshots == NULL)
+      return -1;
+
+    snapshots = peer -> channels [channelID].snapshots;
+    number = snapshots -> outgoingNumber + 1;
+
+    if (snapshots -> acknowledged &&
+        (enet_uint16) (number - snapshots -> acknowledgedNumber) < snapshots -> baselineCount)
+    {
+        baseline = & snapshots -> outgoingBaselines [snapshots -> acknowledgedNumber % snapshots -> baselineCount];
+        if (! baseline -> valid || baseline -> number != snapshots -> acknowledgedNumber)
+          baseline = NULL;
+    }
+
+    packet = enet_packet_create (NULL, ENET_SNAPSHOT_HEADER_SIZE + dataLength, ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT);
+    if (packet == NULL)
+      return -1;
+
+    packet -> data [1] = (enet_uint8) (number >> 8);
+    packet -> data [2] = (enet_uint8) number;
+
+    /* a delta is only used if it ends up smaller than the full snapshot */
+    if (baseline != NULL && dataLength > 0)
+    {
+        enet_uint8 * out = & packet -> data [ENET_SNAPSHOT_HEADER_SIZE],
+                   * outEnd = & packet -> data [packet -> dataLength];
+        size_t deltaLength;
+
+        * out ++ = (enet_uint8) (baseline -> number >> 8);
+        * out ++ = (enet_uint8) baseline -> number;
+        out = enet_peer_write_snapshot_length (out, outEnd, dataLength);
+        if (out != NULL)
+        {
+            deltaLength = enet_peer_encode_snapshot_delta ((const enet_uint8 *) data, dataLength, baseline, out, outEnd - out);
+            if (deltaLength > 0)
+            {
+                packet -> data [0] = ENET_SNAPSHOT_DELTA;
+                packetLength = (out - packet -> data) + deltaLength;
+            }
+        }
+    }
+
+    if (packetLength == 0)
+    {
+        packet -> data [0] = ENET_SNAPSHOT_FULL;
+        memcpy (& packet -> data [ENET_SNAPSHOT_HEADER_SIZE], data, dataLength);
+        packetLength = ENET_SNAPSHOT_HEADER_SIZE + dataLength;
+    }
+
+    packet -> dataLength = packetLength;
+
+    if (enet_peer_store_snapshot (& snapshots -> outgoingBaselines [number % snapshots -> baselineCount], number, (const enet_uint8 *) data, dataLength) < 0 ||
+        enet_peer_send (peer, channelID, packet) < 0)
+    {
+        enet_packet_destroy (packet);
+        return -1;
+    }
+
+    snapshots -> outgoingNumber = number;
+
+    return 0;
+}
+
+static ENetPacket *
+enet_peer_receive_snapshot (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
+{
+    ENetSnapshotChannel * snapshots = peer -> channels [channelID].snapshots;
+    const enet_uint8 * in = packet -> data, * inEnd = & packet -> data [packet -> dataLength];
+    ENetSnapshotBaseline * baseline;
+    ENetPacket * snapshot, * acknowledgement;
+    enet_uint16 number;
+
+    if (packet -> dataLength < ENET_SNAPSHOT_HEADER_SIZE)
+      return NULL;
+
+    number = (enet_uint16) ((in [1] << 8) | in [2]);
+
+    switch (in [0])
+    {
+    case ENET_SNAPSHOT_ACKNOWLEDGE:
+        baseline = & snapshots -> outgoingBaselines [number % snapshots -> baselineCount];
+        if (baseline -> valid && baseline -> number == number &&
+            (! snapshots -> acknowledged || (enet_uint16) (number - snapshots -> acknowledgedNumber) < 0x8000))
+        {
+            snapshots -> acknowledgedNumber = number;
+            snapshots -> acknowledged = 1;
+        }
+        return NULL;
+
+    case ENET_SNAPSHOT_FULL:
+        snapshot = enet_packet_create (& in [ENET_SNAPSHOT_HEADER_SIZE], packet -> dataLength - ENET_SNAPSHOT_HEADER_SIZE, 0);
+        if (snapshot == NULL)
+          return NULL;
+        break;
+
+    case ENET_SNAPSHOT_DELTA:
+    {
+        enet_uint16 baselineNumber;
+        size_t dataLength;
+
+        in += ENET_SNAPSHOT_HEADER_SIZE;
+        if (inEnd - in < 2)
+          return NULL;
+
+        baselineNumber = (enet_uint16) ((in [0] << 8) | in [1]);
+        in = enet_peer_read_snapshot_length (in + 2, inEnd, & dataLength);
+        if (in == NULL || dataLength > peer -> host -> maximumPacketSize)
+          return NULL;
+
+        baseline = & snapshots -> incomingBaselines [baselineNumber % snapshots -> baselineCount];
+        if (! baseline -> valid || baseline -> number != baselineNumber)
+          return NULL;
+
+        snapshot = enet_packet_create (NULL, dataLength, 0);
+        if (snapshot == NULL)
+          return NULL;
+
+        if (enet_peer_decode_snapshot_delta (in, inEnd, baseline, snapshot -> data, dataLength) < 0)
+        {
+            enet_packet_destroy (snapshot);
+            return NULL;
+        }
+        break;
+    }
+
+    default:
+        return NULL;
+    }
+
+    /* only snapshots retained as baselines are acknowledged, so the sender never deltas against one the receiver lacks */
+    if (enet_peer_store_snapshot (& snapshots -> incomingBaselines [number % snapshots -> baselineCount], number, snapshot -> data, snapshot -> dataLength) == 0)
+    {
+        acknowledgement = enet_packet_create (NULL, ENET_SNAPSHOT_HEADER_SIZE, 0);
+        if (acknowledgement != NULL)
+        {
+            acknowledgement -> data [0] = ENET_SNAPSHOT_ACKNOWLEDGE;
+            acknowledgement -> data [1] = (enet_uint8) (number >> 8);
+            acknowledgement -> data [2] = (enet_uint8) number;
+
+            if (enet_peer_send (peer, channelID, acknowledgement) < 0)
+              enet_packet_destroy (acknowledgement);
+        }
+    }
+
+    return snapshot;
+}
+
 /** Attempts to dequeue any incoming queued packet.
     @param peer peer to dequeue packets from
     @param channelID holds the channel ID of the channel the packet was received on success
@@ -231,28 +1006,79 @@ ENetPacket *
 enet_peer_receive (ENetPeer * peer, enet_uint8 * channelID)
 {
    ENetIncomingCommand * incomingCommand;
-   ENetPacket * packet;
-   
-   if (enet_list_empty (& peer -> dispatchedCommands))
-     return NULL;
+   ENetPacket * packet, * snapshot;
+   enet_uint8 packetChannelID, commandNumber;
+
+   for (;;)
+   {
+      if (enet_list_empty (& peer -> dispatchedCommands))
+        return NULL;
+
+      incomingCommand = (ENetIncomingCommand *) enet_list_remove (enet_list_begin (& peer -> dispatchedCommands));
+
+      packetChannelID = incomingCommand -> command.header.channelID;
+      if (channelID != NULL)
+        * channelID = packetChannelID;
+
+      commandNumber = incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK;
+
+      packet = incomingCommand -> packet;
+
+      if (incomingCommand -> fragments != NULL)
+        enet_free (incomingCommand -> fragments);
+
+      enet_free (incomingCommand);
+
+      /* the fragments of a packet delivered ahead on an unordered channel held its place without it */
+      if (packet == NULL)
+        continue;
+
+      -- packet -> referenceCount;
+
+      peer -> totalWaitingData -= ENET_MIN (peer -> totalWaitingData, packet -> dataLength);
+
+      /* a packet the sender abandoned only held the channel's place until the channel got past it */
+      if (commandNumber == ENET_PROTOCOL_COMMAND_SKIP)
+      {
+         if (packet -> referenceCount == 0)
+           enet_packet_destroy (packet);
+
+         continue;
+      }
+
+      if (packetChannelID >= peer -> channelCount || peer -> channels [packetChannelID].snapshots == NULL)
+        return packet;
+
+      snapshot = enet_peer_receive_snapshot (peer, packetChannelID, packet);
 
-   incomingCommand = (ENetIncomingCommand *) enet_list_remove (enet_list_begin (& peer -> dispatchedCommands));
+      if (packet -> referenceCount == 0)
+        enet_packet_destroy (packet);
 
-   if (channelID != NULL)
-     * channelID = incomingCommand -> command.header.channelID;
+      /* acknowledgements and undecodable deltas are consumed here rather than handed to the user */
+      if (snapshot != NULL)
+        return snapshot;
+   }
+}
 
-   packet = incomingCommand -> packet;
+/** Accounts for a fragment of a reliable packet that is acknowledged or will no longer be sent.
+    @returns 1 if no other fragment of the packet remains unacknowledged by the peer, 0 otherwise
+*/
+int
+enet_peer_release_fragment (ENetOutgoingCommand * outgoingCommand)
+{
+    enet_uint32 * unacknowledgedFragments = outgoingCommand -> unacknowledgedFragments;
 
-   -- packet -> referenceCount;
+    if (unacknowledgedFragments == NULL)
+      return 0;
 
-   if (incomingCommand -> fragments != NULL)
-     enet_free (incomingCommand -> fragments);
+    outgoingCommand -> unacknowledgedFragments = NULL;
 
-   enet_free (incomingCommand);
+    if (-- * unacknowledgedFragments > 0)
+      return 0;
 
-   peer -> totalWaitingData -= ENET_MIN (peer -> totalWaitingData, packet -> dataLength);
+    enet_free (unacknowledgedFragments);
 
-   return packet;
+    return 1;
 }
 
 static void
@@ -266,6 +1092,8 @@ enet_peer_reset_outgoing_commands (ENetPeer * peer, ENetList * queue)
 
        if (outgoingCommand -> packet != NULL)
        {
+          enet_peer_release_fragment (outgoingCommand);
+
           -- outgoingCommand -> packet -> referenceCount;
 
           if (outgoingCommand -> packet -> referenceCount == 0)
@@ -343,6 +1171,12 @@ enet_peer_reset_queues (ENetPeer * peer)
         {
             enet_peer_reset_incoming_commands (peer, & channel -> incomingReliableCommands);
             enet_peer_reset_incoming_commands (peer, & channel -> incomingUnreliableCommands);
+
+            if (channel -> snapshots != NULL)
+              enet_peer_destroy_snapshots (channel -> snapshots);
+
+            if (channel -> unorderedWindow != NULL)
+              enet_free (channel -> unorderedWindow);
         }
 
         enet_free (peer -> channels);
@@ -376,6 +1210,22 @@ enet_peer_on_disconnect (ENetPeer * peer)
     }
 }
 
+static void
+enet_peer_destroy_compression_history (ENetCompressionHistory * history)
+{
+    size_t i;
+
+    for (i = 0; i < ENET_PEER_COMPRESSION_HISTORY; ++ i)
+    {
+        if (history -> outgoingRecords [i].data != NULL)
+          enet_free (history -> outgoingRecords [i].data);
+        if (history -> incomingRecords [i].data != NULL)
+          enet_free (history -> incomingRecords [i].data);
+    }
+
+    enet_free (history);
+}
+
 /** Forcefully disconnects a peer.
     @param peer peer to forcefully disconnect
     @remarks The foreign host represented by the peer is not notified of the disconnection and will timeout
@@ -389,6 +1239,9 @@ enet_peer_reset (ENetPeer * peer)
     peer -> outgoingPeerID = ENET_PROTOCOL_MAXIMUM_PEER_ID;
     peer -> connectID = 0;
 
+    if (peer -> state != ENET_PEER_STATE_DISCONNECTED)
+      ENET_TRACE (peer -> host, ENET_TRACE_EVENT_PEER_STATE_CHANGED, peer_state_changed, peer -> incomingPeerID, peer -> state, ENET_PEER_STATE_DISCONNECTED, 0);
+
     peer -> state = ENET_PEER_STATE_DISCONNECTED;
 
     peer -> incomingBandwidth = 0;
@@ -429,11 +1282,37 @@ enet_peer_reset (ENetPeer * peer)
     peer -> windowSize = ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE;
     peer -> incomingUnsequencedGroup = 0;
     peer -> outgoingUnsequencedGroup = 0;
+    peer -> scheduleTime = 0;
+    peer -> reliableSendOrder = 0;
     peer -> eventData = 0;
     peer -> totalWaitingData = 0;
     peer -> flags = 0;
+    peer -> protocolFeatures = 0;
+    peer -> compressionYield = ENET_PEER_COMPRESSION_YIELD_SCALE;
+    peer -> compressionProbeCounter = 0;
+    peer -> pacingBudget = 0;
+    peer -> pacingTime = 0;
+    peer -> acknowledgementDelay = 0;
+    peer -> acknowledgementFrequency = 0;
+    peer -> remoteAcknowledgementDelay = 0;
+    peer -> mtuProbeMaximum = 0;
+    peer -> mtuProbeLow = 0;
+    peer -> mtuProbeHigh = 0;
+    peer -> mtuProbeSize = 0;
+    peer -> mtuProbeAttempts = 0;
+    peer -> mtuProbeTime = 0;
 
     memset (peer -> unsequencedWindow, 0, sizeof (peer -> unsequencedWindow));
+    memset (& peer -> compressionStatistics, 0, sizeof (peer -> compressionStatistics));
+    memset (& peer -> histograms, 0, sizeof (peer -> histograms));
+
+    if (peer -> compressionHistory != NULL)
+    {
+        enet_peer_destroy_compression_history (peer -> compressionHistory);
+        peer -> compressionHistory = NULL;
+    }
+
+    enet_peer_congestion_destroy (peer);
     
     enet_peer_reset_queues (peer);
 }
@@ -474,6 +1353,28 @@ enet_peer_ping_interval (ENetPeer * peer, enet_uint32 pingInterval)
     peer -> pingInterval = pingInterval ? pingInterval : ENET_PEER_PING_INTERVAL;
 }
 
+/** Lets acknowledgements to a peer wait briefly for data going back to it.
+
+    A peer that mostly receives would otherwise answer nearly every datagram with one of its own
+    carrying nothing but acknowledgements. Held back acknowledgements go out with the next data
+    sent to the peer, once the oldest has waited the given delay, or once the given number has
+    queued up, whichever comes first. Reliable commands arriving out of order or twice are
+    acknowledged at once so that the peer learns of losses quickly, as are connection commands.
+    The delay lengthens the round trip time the peer measures, unless both sides enabled range
+    acknowledgements, which tell the peer how long they were held back.
+
+    @param peer the peer to adjust
+    @param delay the longest time in milliseconds acknowledgements may wait; 0 sends them at once, the default
+    @param commands the number of queued acknowledgements that are sent at once; 0 for no limit
+    @sa enet_host_acknowledge_ranges()
+*/
+void
+enet_peer_delay_acknowledgements (ENetPeer * peer, enet_uint32 delay, enet_uint32 commands)
+{
+    peer -> acknowledgementDelay = delay;
+    peer -> acknowledgementFrequency = commands;
+}
+
 /** Sets the timeout parameters for a peer.
 
     The timeout parameter control how and when a peer will timeout from a failure to acknowledge
@@ -565,6 +1466,8 @@ enet_peer_disconnect (ENetPeer * peer, enet_uint32 data)
     {
         enet_peer_on_disconnect (peer);
 
+        ENET_TRACE (peer -> host, ENET_TRACE_EVENT_PEER_STATE_CHANGED, peer_state_changed, peer -> incomingPeerID, peer -> state, ENET_PEER_STATE_DISCONNECTING, 0);
+
         peer -> state = ENET_PEER_STATE_DISCONNECTING;
     }
     else
@@ -597,6 +1500,8 @@ enet_peer_disconnect_later (ENetPeer * peer, enet_uint32 data)
     if ((peer -> state == ENET_PEER_STATE_CONNECTED || peer -> state == ENET_PEER_STATE_DISCONNECT_LATER) && 
         enet_peer_has_outgoing_commands (peer))
     {
+        ENET_TRACE (peer -> host, ENET_TRACE_EVENT_PEER_STATE_CHANGED, peer_state_changed, peer -> incomingPeerID, peer -> state, ENET_PEER_STATE_DISCONNECT_LATER, 0);
+
         peer -> state = ENET_PEER_STATE_DISCONNECT_LATER;
         peer -> eventData = data;
     }
@@ -613,14 +1518,24 @@ enet_peer_queue_acknowledgement (ENetPeer * peer, const ENetProtocol * command,
     {
         ENetChannel * channel = & peer -> channels [command -> header.channelID];
         enet_uint16 reliableWindow = command -> header.reliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE,
-                    currentWindow = channel -> incomingReliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
+                    currentWindow = channel -> incomingReliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE,
+                    sequenceAdvance;
 
         if (command -> header.reliableSequenceNumber < channel -> incomingReliableSequenceNumber)
            reliableWindow += ENET_PEER_RELIABLE_WINDOWS;
 
         if (reliableWindow >= currentWindow + ENET_PEER_FREE_RELIABLE_WINDOWS - 1 && reliableWindow <= currentWindow + ENET_PEER_FREE_RELIABLE_WINDOWS)
           return NULL;
+
+        /* a gap or a duplicate tells the sender something was lost, so it is acknowledged without delay */
+        sequenceAdvance = command -> header.reliableSequenceNumber - channel -> acknowledgedReliableSequenceNumber;
+        if (sequenceAdvance != 1)
+          peer -> flags |= ENET_PEER_FLAG_ACKNOWLEDGE_NOW;
+        if (sequenceAdvance > 0 && sequenceAdvance < 0x8000)
+          channel -> acknowledgedReliableSequenceNumber = command -> header.reliableSequenceNumber;
     }
+    else
+      peer -> flags |= ENET_PEER_FLAG_ACKNOWLEDGE_NOW;
 
     acknowledgement = (ENetAcknowledgement *) enet_malloc (sizeof (ENetAcknowledgement));
     if (acknowledgement == NULL)
@@ -629,6 +1544,7 @@ enet_peer_queue_acknowledgement (ENetPeer * peer, const ENetProtocol * command,
     peer -> outgoingDataTotal += sizeof (ENetProtocolAcknowledge);
 
     acknowledgement -> sentTime = sentTime;
+    acknowledgement -> receivedTime = peer -> host -> serviceTime;
     acknowledgement -> command = * command;
     
     enet_list_insert (enet_list_end (& peer -> acknowledgements), acknowledgement);
@@ -636,6 +1552,95 @@ enet_peer_queue_acknowledgement (ENetPeer * peer, const ENetProtocol * command,
     return acknowledgement;
 }
 
+/* Queues a command in order of priority and then of virtual start time, as in start-time fair
+   queuing: a channel's packet starts at the later of the current virtual time and the finish of
+   the channel's previous packet, and finishes its length scaled down by the channel's weight later.
+   Protocol commands on channel 0xFF go ahead of all data, and the fragments of an unreliable
+   packet share its start so that nothing comes between them for the throttle to split. */
+static void
+enet_peer_schedule_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoingCommand, ENetList * list)
+{
+    const enet_uint64 timeMask = ((enet_uint64) 1 << ENET_PEER_SCHEDULE_TIME_BITS) - 1;
+
+    if (outgoingCommand -> command.header.channelID >= peer -> channelCount)
+      outgoingCommand -> queueOrder = peer -> scheduleTime;
+    else
+    {
+        ENetChannel * channel = & peer -> channels [outgoingCommand -> command.header.channelID];
+
+        if (! (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE) &&
+            (outgoingCommand -> fragmentOffset != 0 ||
+              (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_SEND_PARITY_FRAGMENT))
+          outgoingCommand -> queueOrder = channel -> scheduleStart;
+        else
+        {
+            enet_uint64 length = enet_protocol_command_size (outgoingCommand -> command.header.command);
+
+            if ((outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT)
+              length += outgoingCommand -> packet -> dataLength;
+            else
+              length += outgoingCommand -> fragmentLength;
+
+            channel -> scheduleStart = channel -> scheduleFinish > peer -> scheduleTime ? channel -> scheduleFinish : peer -> scheduleTime;
+            channel -> scheduleFinish = channel -> scheduleStart + (length * ENET_CHANNEL_DEFAULT_WEIGHT + channel -> weight - 1) / channel -> weight;
+            channel -> scheduleStart &= timeMask;
+            channel -> scheduleFinish &= timeMask;
+
+            outgoingCommand -> queueOrder = channel -> scheduleStart;
+        }
+
+        outgoingCommand -> queueOrder |= (enet_uint64) (256 - channel -> priority) << ENET_PEER_SCHEDULE_TIME_BITS;
+    }
+
+    enet_peer_insert_outgoing_command (list, outgoingCommand);
+}
+
+/** Inserts a command into an outgoing queue at the position of its queue order, after any
+    command of the same order. A channel's commands start strictly later than the ones queued
+    before them, so a retransmitted command goes back ahead of those queued after it.
+*/
+void
+enet_peer_insert_outgoing_command (ENetList * list, ENetOutgoingCommand * outgoingCommand)
+{
+    ENetOutgoingCommand * front, * back;
+    ENetListIterator currentCommand;
+
+    if (enet_list_empty (list))
+    {
+        enet_list_insert (enet_list_end (list), outgoingCommand);
+        return;
+    }
+
+    front = (ENetOutgoingCommand *) enet_list_front (list);
+    back = (ENetOutgoingCommand *) enet_list_back (list);
+
+    /* most commands belong at the back, but those of a channel that was idle go near the front */
+    if (outgoingCommand -> queueOrder < front -> queueOrder ||
+        (outgoingCommand -> queueOrder < back -> queueOrder &&
+          outgoingCommand -> queueOrder - front -> queueOrder < back -> queueOrder - outgoingCommand -> queueOrder))
+    {
+        for (currentCommand = enet_list_begin (list);
+             currentCommand != enet_list_end (list);
+             currentCommand = enet_list_next (currentCommand))
+        {
+           if (((ENetOutgoingCommand *) currentCommand) -> queueOrder > outgoingCommand -> queueOrder)
+             break;
+        }
+    }
+    else
+    {
+        for (currentCommand = enet_list_end (list);
+             currentCommand != enet_list_begin (list);
+             currentCommand = enet_list_previous (currentCommand))
+        {
+           if (((ENetOutgoingCommand *) enet_list_previous (currentCommand)) -> queueOrder <= outgoingCommand -> queueOrder)
+             break;
+        }
+    }
+
+    enet_list_insert (currentCommand, outgoingCommand);
+}
+
 void
 enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoingCommand)
 {
@@ -670,7 +1675,8 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
         }
         else
         {
-           if (outgoingCommand -> fragmentOffset == 0)
+           if (outgoingCommand -> fragmentOffset == 0 &&
+               (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_SEND_PARITY_FRAGMENT)
              ++ channel -> outgoingUnreliableSequenceNumber;
 
            outgoingCommand -> reliableSequenceNumber = channel -> outgoingReliableSequenceNumber;
@@ -681,8 +1687,9 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
     outgoingCommand -> sendAttempts = 0;
     outgoingCommand -> sentTime = 0;
     outgoingCommand -> roundTripTimeout = 0;
+    outgoingCommand -> sendOrder = 0;
     outgoingCommand -> command.header.reliableSequenceNumber = ENET_HOST_TO_NET_16 (outgoingCommand -> reliableSequenceNumber);
-    outgoingCommand -> queueTime = ++ peer -> host -> totalQueued;
+    outgoingCommand -> enqueueTime = peer -> host -> serviceTime;
 
     switch (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK)
     {
@@ -698,11 +1705,14 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
         break;
     }
 
+    ENET_TRACE (peer -> host, ENET_TRACE_EVENT_COMMAND_QUEUED, command_queued, peer -> incomingPeerID,
+                outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK, outgoingCommand -> reliableSequenceNumber, outgoingCommand -> fragmentLength);
+
     if ((outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE) != 0 &&
         outgoingCommand -> packet != NULL)
-      enet_list_insert (enet_list_end (& peer -> outgoingSendReliableCommands), outgoingCommand);
+      enet_peer_schedule_outgoing_command (peer, outgoingCommand, & peer -> outgoingSendReliableCommands);
     else
-      enet_list_insert (enet_list_end (& peer -> outgoingCommands), outgoingCommand);
+      enet_peer_schedule_outgoing_command (peer, outgoingCommand, & peer -> outgoingCommands);
 }
 
 ENetOutgoingCommand *
@@ -716,6 +1726,7 @@ enet_peer_queue_outgoing_command (ENetPeer * peer, const ENetProtocol * command,
     outgoingCommand -> fragmentOffset = offset;
     outgoingCommand -> fragmentLength = length;
     outgoingCommand -> packet = packet;
+    outgoingCommand -> unacknowledgedFragments = NULL;
     if (packet != NULL)
       ++ packet -> referenceCount;
 
@@ -807,39 +1818,106 @@ enet_peer_dispatch_incoming_unreliable_commands (ENetPeer * peer, ENetChannel *
     enet_peer_remove_incoming_commands (peer, & channel -> incomingUnreliableCommands, enet_list_begin (& channel -> incomingUnreliableCommands), droppedCommand, queuedCommand);
 }
 
+/* Delivers a complete reliable packet on an unordered channel ahead of the packets still missing
+   before it. A packet of one command is marked in the unordered window, while the start command
+   of a fragmented one is left behind without its packet to hold its sequence numbers. */
+static void
+enet_peer_dispatch_unordered_command (ENetPeer * peer, ENetChannel * channel, ENetIncomingCommand * incomingCommand)
+{
+    if (incomingCommand -> fragmentCount > 0)
+    {
+       ENetIncomingCommand * dispatchedCommand = (ENetIncomingCommand *) enet_malloc (sizeof (ENetIncomingCommand));
+       if (dispatchedCommand == NULL)
+         return;
+
+       * dispatchedCommand = * incomingCommand;
+       dispatchedCommand -> fragments = NULL;
+
+       incomingCommand -> command.header.command = (incomingCommand -> command.header.command & ~ ENET_PROTOCOL_COMMAND_MASK) | ENET_PROTOCOL_COMMAND_SKIP;
+       incomingCommand -> packet = NULL;
+
+       enet_list_insert (enet_list_end (& peer -> dispatchedCommands), dispatchedCommand);
+    }
+    else
+    {
+       enet_uint16 index = incomingCommand -> reliableSequenceNumber % ENET_PEER_UNORDERED_WINDOW_SIZE;
+
+       channel -> unorderedWindow [index / 32] |= 1u << (index % 32);
+
+       enet_list_insert (enet_list_end (& peer -> dispatchedCommands), enet_list_remove (& incomingCommand -> incomingCommandList));
+    }
+
+    if (! (peer -> flags & ENET_PEER_FLAG_NEEDS_DISPATCH))
+    {
+       enet_list_insert (enet_list_end (& peer -> host -> dispatchQueue), & peer -> dispatchList);
+
+       peer -> flags |= ENET_PEER_FLAG_NEEDS_DISPATCH;
+    }
+}
+
 void
 enet_peer_dispatch_incoming_reliable_commands (ENetPeer * peer, ENetChannel * channel, ENetIncomingCommand * queuedCommand)
 {
+    enet_uint16 reliableSequenceNumber = channel -> incomingReliableSequenceNumber;
     ENetListIterator currentCommand;
 
-    for (currentCommand = enet_list_begin (& channel -> incomingReliableCommands);
-         currentCommand != enet_list_end (& channel -> incomingReliableCommands);
-         currentCommand = enet_list_next (currentCommand))
+    if (queuedCommand != NULL &&
+        (channel -> flags & ENET_CHANNEL_FLAG_UNORDERED) &&
+        queuedCommand -> fragmentsRemaining <= 0 &&
+        queuedCommand -> reliableSequenceNumber != (enet_uint16) (channel -> incomingReliableSequenceNumber + 1) &&
+        (queuedCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_SKIP)
     {
-       ENetIncomingCommand * incomingCommand = (ENetIncomingCommand *) currentCommand;
+       enet_peer_dispatch_unordered_command (peer, channel, queuedCommand);
+       return;
+    }
+
+    for (currentCommand = enet_list_begin (& channel -> incomingReliableCommands);; )
+    {
+       ENetIncomingCommand * incomingCommand;
+       enet_uint16 nextSequenceNumber = channel -> incomingReliableSequenceNumber + 1,
+                   index = nextSequenceNumber % ENET_PEER_UNORDERED_WINDOW_SIZE;
+
+       if (channel -> unorderedWindow != NULL &&
+           (channel -> unorderedWindow [index / 32] & (1u << (index % 32))))
+       {
+          channel -> unorderedWindow [index / 32] &= ~ (1u << (index % 32));
+
+          channel -> incomingReliableSequenceNumber = nextSequenceNumber;
+          continue;
+       }
+
+       if (currentCommand == enet_list_end (& channel -> incomingReliableCommands))
+         break;
+
+       incomingCommand = (ENetIncomingCommand *) currentCommand;
          
        if (incomingCommand -> fragmentsRemaining > 0 ||
-           incomingCommand -> reliableSequenceNumber != (enet_uint16) (channel -> incomingReliableSequenceNumber + 1))
+           incomingCommand -> reliableSequenceNumber != nextSequenceNumber)
          break;
 
        channel -> incomingReliableSequenceNumber = incomingCommand -> reliableSequenceNumber;
 
        if (incomingCommand -> fragmentCount > 0)
          channel -> incomingReliableSequenceNumber += incomingCommand -> fragmentCount - 1;
+
+       currentCommand = enet_list_next (currentCommand);
     } 
 
-    if (currentCommand == enet_list_begin (& channel -> incomingReliableCommands))
+    if (channel -> incomingReliableSequenceNumber == reliableSequenceNumber)
       return;
 
     channel -> incomingUnreliableSequenceNumber = 0;
 
-    enet_list_move (enet_list_end (& peer -> dispatchedCommands), enet_list_begin (& channel -> incomingReliableCommands), enet_list_previous (currentCommand));
-
-    if (! (peer -> flags & ENET_PEER_FLAG_NEEDS_DISPATCH))
+    if (currentCommand != enet_list_begin (& channel -> incomingReliableCommands))
     {
-       enet_list_insert (enet_list_end (& peer -> host -> dispatchQueue), & peer -> dispatchList);
+       enet_list_move (enet_list_end (& peer -> dispatchedCommands), enet_list_begin (& channel -> incomingReliableCommands), enet_list_previous (currentCommand));
 
-       peer -> flags |= ENET_PEER_FLAG_NEEDS_DISPATCH;
+       if (! (peer -> flags & ENET_PEER_FLAG_NEEDS_DISPATCH))
+       {
+          enet_list_insert (enet_list_end (& peer -> host -> dispatchQueue), & peer -> dispatchList);
+
+          peer -> flags |= ENET_PEER_FLAG_NEEDS_DISPATCH;
+       }
     }
 
     if (! enet_list_empty (& channel -> incomingUnreliableCommands))
@@ -871,15 +1949,26 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
            reliableWindow += ENET_PEER_RELIABLE_WINDOWS;
 
         if (reliableWindow < currentWindow || reliableWindow >= currentWindow + ENET_PEER_FREE_RELIABLE_WINDOWS - 1)
-          goto discardCommand;
+        {
+            if (reliableSequenceNumber < channel -> incomingReliableSequenceNumber)
+              goto duplicateCommand;
+
+            ++ peer -> host -> counters.drops [ENET_DROP_REASON_OUTSIDE_WINDOW];
+            goto discardCommand;
+        }
     }
                     
     switch (command -> header.command & ENET_PROTOCOL_COMMAND_MASK)
     {
     case ENET_PROTOCOL_COMMAND_SEND_FRAGMENT:
     case ENET_PROTOCOL_COMMAND_SEND_RELIABLE:
+    case ENET_PROTOCOL_COMMAND_SKIP:
        if (reliableSequenceNumber == channel -> incomingReliableSequenceNumber)
-         goto discardCommand;
+         goto duplicateCommand;
+
+       if (channel -> unorderedWindow != NULL &&
+           (channel -> unorderedWindow [(reliableSequenceNumber % ENET_PEER_UNORDERED_WINDOW_SIZE) / 32] & (1u << (reliableSequenceNumber % 32))))
+         goto duplicateCommand;
        
        for (currentCommand = enet_list_previous (enet_list_end (& channel -> incomingReliableCommands));
             currentCommand != enet_list_end (& channel -> incomingReliableCommands);
@@ -901,7 +1990,7 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
              if (incomingCommand -> reliableSequenceNumber < reliableSequenceNumber)
                break;
 
-             goto discardCommand;
+             goto duplicateCommand;
           }
        }
        break;
@@ -912,7 +2001,7 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
 
        if (reliableSequenceNumber == channel -> incomingReliableSequenceNumber && 
            unreliableSequenceNumber <= channel -> incomingUnreliableSequenceNumber)
-         goto discardCommand;
+         goto duplicateCommand;
 
        for (currentCommand = enet_list_previous (enet_list_end (& channel -> incomingUnreliableCommands));
             currentCommand != enet_list_end (& channel -> incomingUnreliableCommands);
@@ -943,7 +2032,7 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
              if (incomingCommand -> unreliableSequenceNumber < unreliableSequenceNumber)
                break;
 
-             goto discardCommand;
+             goto duplicateCommand;
           }
        }
        break;
@@ -957,7 +2046,10 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
     }
 
     if (peer -> totalWaitingData >= peer -> host -> maximumWaitingData)
-      goto notifyError;
+    {
+        ++ peer -> host -> counters.drops [ENET_DROP_REASON_WAITING_DATA_LIMIT];
+        goto notifyError;
+    }
 
     packet = enet_packet_create (data, dataLength, flags);
     if (packet == NULL)
@@ -974,6 +2066,7 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
     incomingCommand -> fragmentsRemaining = fragmentCount;
     incomingCommand -> packet = packet;
     incomingCommand -> fragments = NULL;
+    incomingCommand -> receiveTime = peer -> host -> serviceTime;
     
     if (fragmentCount > 0)
     { 
@@ -1001,6 +2094,7 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
     {
     case ENET_PROTOCOL_COMMAND_SEND_FRAGMENT:
     case ENET_PROTOCOL_COMMAND_SEND_RELIABLE:
+    case ENET_PROTOCOL_COMMAND_SKIP:
        enet_peer_dispatch_incoming_reliable_commands (peer, channel, incomingCommand);
        break;
 
@@ -1011,6 +2105,9 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
 
     return incomingCommand;
 
+duplicateCommand:
+    ++ peer -> host -> counters.drops [ENET_DROP_REASON_DUPLICATE];
+
 discardCommand:
     if (fragmentCount > 0)
       goto notifyError;
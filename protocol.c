@@ -8,6 +8,7 @@
 #include "enet/utility.h"
 #include "enet/time.h"
 #include "enet/enet.h"
+#include "enet/trace.h"
 
 static const size_t commandSizes [ENET_PROTOCOL_COMMAND_COUNT] =
 {
@@ -23,7 +24,10 @@ static const size_t commandSizes [ENET_PROTOCOL_COMMAND_COUNT] =
     sizeof (ENetProtocolSendUnsequenced),
     sizeof (ENetProtocolBandwidthLimit),
     sizeof (ENetProtocolThrottleConfigure),
-    sizeof (ENetProtocolSendFragment)
+    sizeof (ENetProtocolSendFragment),
+    sizeof (ENetProtocolAcknowledgeRange),
+    sizeof (ENetProtocolSendParityFragment),
+    sizeof (ENetProtocolSkip)
 };
 
 size_t
@@ -40,6 +44,8 @@ enet_protocol_change_state (ENetHost * host, ENetPeer * peer, ENetPeerState stat
     else
       enet_peer_on_disconnect (peer);
 
+    ENET_TRACE (host, ENET_TRACE_EVENT_PEER_STATE_CHANGED, peer_state_changed, peer -> incomingPeerID, peer -> state, state, 0);
+
     peer -> state = state;
 }
 
@@ -203,12 +209,11 @@ enet_protocol_find_sent_reliable_command (ENetList * list, enet_uint16 reliableS
     {
        ENetOutgoingCommand * outgoingCommand = (ENetOutgoingCommand *) currentCommand;
 
-       if (! (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE))
+       /* retransmissions go back to their place in the schedule, so they may follow commands never sent */
+       if (! (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE) ||
+           outgoingCommand -> sendAttempts < 1)
          continue;
 
-       if (outgoingCommand -> sendAttempts < 1)
-         break;
-
        if (outgoingCommand -> reliableSequenceNumber == reliableSequenceNumber &&
            outgoingCommand -> command.header.channelID == channelID)
          return outgoingCommand;
@@ -217,41 +222,460 @@ enet_protocol_find_sent_reliable_command (ENetList * list, enet_uint16 reliableS
     return NULL;
 }
 
-static ENetProtocolCommand
-enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliableSequenceNumber, enet_uint8 channelID)
+static int
+enet_protocol_agree_features (ENetHost * host, ENetPeer * peer, enet_uint32 features)
 {
-    ENetOutgoingCommand * outgoingCommand = NULL;
+    peer -> protocolFeatures = features & host -> protocolFeatures & ENET_PROTOCOL_FEATURE_MASK;
+
+    if (peer -> protocolFeatures & ENET_PROTOCOL_FEATURE_COMPRESSION_HISTORY)
+    {
+        peer -> compressionHistory = (ENetCompressionHistory *) enet_malloc (sizeof (ENetCompressionHistory));
+        if (peer -> compressionHistory == NULL)
+        {
+            peer -> protocolFeatures &= ~ ENET_PROTOCOL_FEATURE_COMPRESSION_HISTORY;
+            return -1;
+        }
+
+        memset (peer -> compressionHistory, 0, sizeof (ENetCompressionHistory));
+    }
+
+    return 0;
+}
+
+static int
+enet_protocol_reserve_compression_record (ENetCompressionRecord * record, size_t dataLength)
+{
+    enet_uint8 * data;
+
+    if (dataLength <= record -> dataSize)
+      return 0;
+
+    data = (enet_uint8 *) enet_malloc (dataLength);
+    if (data == NULL)
+      return -1;
+
+    if (record -> data != NULL)
+      enet_free (record -> data);
+    record -> data = data;
+    record -> dataSize = dataLength;
+    return 0;
+}
+
+static void
+enet_protocol_store_compression_history (ENetCompressionHistory * history, enet_uint8 number, const enet_uint8 * data, size_t dataLength)
+{
+    ENetCompressionRecord * record = NULL;
+    size_t i;
+
+    /* a duplicated datagram replaces itself rather than pushing out an older record */
+    for (i = 0; i < ENET_PEER_COMPRESSION_HISTORY; ++ i)
+    {
+        if (history -> incomingRecords [i].number == number)
+        {
+            record = & history -> incomingRecords [i];
+            break;
+        }
+    }
+
+    if (record == NULL)
+    {
+        record = & history -> incomingRecords [history -> nextIncomingRecord];
+        history -> nextIncomingRecord = (history -> nextIncomingRecord + 1) % ENET_PEER_COMPRESSION_HISTORY;
+    }
+
+    if (enet_protocol_reserve_compression_record (record, dataLength) < 0)
+    {
+        record -> number = 0;
+        return;
+    }
+
+    memcpy (record -> data, data, dataLength);
+    record -> number = number;
+    record -> dataLength = dataLength;
+}
+
+static void
+enet_protocol_acknowledge_compression_history (ENetCompressionHistory * history, enet_uint8 channelID, enet_uint16 reliableSequenceNumber, enet_uint16 sentTime)
+{
+    ENetCompressionRecord * record, * acknowledged = NULL;
+
+    for (record = history -> outgoingRecords; record < & history -> outgoingRecords [ENET_PEER_COMPRESSION_HISTORY]; ++ record)
+    {
+        if (record -> number != 0 &&
+            ! record -> acknowledged &&
+            record -> channelID == channelID &&
+            record -> reliableSequenceNumber == reliableSequenceNumber &&
+            record -> sentTime == sentTime)
+        {
+            acknowledged = record;
+            break;
+        }
+    }
+
+    if (acknowledged == NULL)
+      return;
+
+    acknowledged -> acknowledged = 1;
+
+    /* numbers wrap, but only a handful of records are ever outstanding, so the difference decides which is newer */
+    if (history -> outgoingDictionary != NULL &&
+        (enet_uint8) (history -> outgoingDictionary -> number - acknowledged -> number) < 0x80)
+    {
+        acknowledged -> number = 0;
+        return;
+    }
+
+    history -> outgoingDictionary = acknowledged;
+
+    for (record = history -> outgoingRecords; record < & history -> outgoingRecords [ENET_PEER_COMPRESSION_HISTORY]; ++ record)
+    {
+        if (record != acknowledged &&
+            record -> number != 0 &&
+            (enet_uint8) (acknowledged -> number - record -> number) < 0x80)
+          record -> number = 0;
+    }
+}
+
+static void
+enet_protocol_reset_compression_history (ENetCompressionHistory * history)
+{
+    ENetCompressionRecord * record;
+
+    for (record = history -> outgoingRecords; record < & history -> outgoingRecords [ENET_PEER_COMPRESSION_HISTORY]; ++ record)
+      record -> number = 0;
+
+    history -> outgoingDictionary = NULL;
+}
+
+/* Path MTU probes are reliable pings padded out with zeroes, which peers stop parsing at,
+   and the only pings carrying a packet. */
+static int
+enet_protocol_is_mtu_probe (const ENetOutgoingCommand * outgoingCommand)
+{
+    return (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_PING &&
+           outgoingCommand -> packet != NULL;
+}
+
+static void
+enet_protocol_start_mtu_discovery (ENetHost * host, ENetPeer * peer)
+{
+    if (host -> maximumMtu == 0)
+      return;
+
+    peer -> mtuProbeMaximum = peer -> mtu;
+    peer -> mtuProbeHigh = peer -> mtu;
+    if (peer -> mtu > host -> mtu)
+      peer -> mtu = host -> mtu;
+    peer -> mtuProbeLow = peer -> mtu;
+    peer -> mtuProbeSize = 0;
+    peer -> mtuProbeAttempts = 0;
+    peer -> mtuProbeTime = host -> serviceTime;
+}
+
+static void
+enet_protocol_schedule_mtu_probe (ENetHost * host, ENetPeer * peer)
+{
+    peer -> mtuProbeSize = 0;
+
+    if (peer -> mtuProbeLow + ENET_PEER_MTU_PROBE_GRANULARITY <= peer -> mtuProbeHigh)
+    {
+       peer -> mtuProbeTime = host -> serviceTime;
+       return;
+    }
+
+    /* once the search settles, larger sizes are only tried again after the path had time to change */
+    peer -> mtuProbeHigh = peer -> mtuProbeMaximum;
+    peer -> mtuProbeTime = host -> serviceTime + ENET_PEER_MTU_PROBE_INTERVAL;
+}
+
+static void
+enet_protocol_probe_mtu (ENetHost * host, ENetPeer * peer)
+{
+    ENetProtocol command;
+    ENetPacket * packet;
+    enet_uint32 size = (peer -> mtuProbeLow + peer -> mtuProbeHigh + 1) / 2,
+                paddingLength = size - sizeof (ENetProtocolHeader) - sizeof (ENetProtocolPing);
+
+    packet = enet_packet_create (NULL, paddingLength, 0);
+    if (packet == NULL)
+      return;
+
+    memset (packet -> data, 0, paddingLength);
+
+    command.header.command = ENET_PROTOCOL_COMMAND_PING | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
+    command.header.channelID = 0xFF;
+
+    /* like other protocol commands, the probe is scheduled ahead of any data queued before it */
+    if (enet_peer_queue_outgoing_command (peer, & command, packet, 0, paddingLength) == NULL)
+    {
+       enet_packet_destroy (packet);
+       return;
+    }
+
+    peer -> mtuProbeSize = size;
+}
+
+static void
+enet_protocol_confirm_mtu_probe (ENetHost * host, ENetPeer * peer)
+{
+    if (peer -> mtuProbeSize > peer -> mtuProbeLow && peer -> mtuProbeSize <= peer -> mtuProbeHigh)
+    {
+       peer -> mtuProbeLow = peer -> mtuProbeSize;
+       peer -> mtu = peer -> mtuProbeSize;
+    }
+
+    peer -> mtuProbeAttempts = 0;
+
+    enet_protocol_schedule_mtu_probe (host, peer);
+}
+
+/* A lost probe is neither retransmitted nor taken for congestion, but after several losses in
+   a row the path is taken not to carry its size. */
+static void
+enet_protocol_lose_mtu_probe (ENetHost * host, ENetPeer * peer, ENetOutgoingCommand * outgoingCommand)
+{
+    peer -> reliableDataInTransit -= outgoingCommand -> fragmentLength;
+
+    enet_list_remove (& outgoingCommand -> outgoingCommandList);
+
+    if (-- outgoingCommand -> packet -> referenceCount == 0)
+      enet_packet_destroy (outgoingCommand -> packet);
+
+    enet_free (outgoingCommand);
+
+    if (++ peer -> mtuProbeAttempts >= ENET_PEER_MTU_PROBE_ATTEMPTS)
+    {
+       peer -> mtuProbeHigh = peer -> mtuProbeSize - 1;
+       peer -> mtuProbeAttempts = 0;
+    }
+
+    enet_protocol_schedule_mtu_probe (host, peer);
+}
+
+/* Reliable commands too large for the minimum MTU going unacknowledged time and again hint at
+   the path no longer carrying the MTU in use, so it falls back to the minimum and searches anew. */
+static void
+enet_protocol_detect_mtu_black_hole (ENetHost * host, ENetPeer * peer, const ENetOutgoingCommand * outgoingCommand)
+{
+    if (peer -> mtuProbeMaximum == 0 ||
+        peer -> mtu <= ENET_PROTOCOL_MINIMUM_MTU ||
+        outgoingCommand -> sendAttempts != ENET_PEER_MTU_BLACK_HOLE_ATTEMPTS ||
+        sizeof (ENetProtocolHeader) + commandSizes [outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK] +
+          outgoingCommand -> fragmentLength <= ENET_PROTOCOL_MINIMUM_MTU)
+      return;
+
+    peer -> mtuProbeHigh = peer -> mtu;
+    peer -> mtuProbeLow = ENET_PROTOCOL_MINIMUM_MTU;
+    peer -> mtu = ENET_PROTOCOL_MINIMUM_MTU;
+    peer -> mtuProbeAttempts = 0;
+
+    if (peer -> mtuProbeSize == 0)
+      peer -> mtuProbeTime = host -> serviceTime;
+}
+
+/* Moves a sent reliable command presumed lost back into the outgoing queues at its place in the schedule. */
+static void
+enet_protocol_retransmit_command (ENetHost * host, ENetPeer * peer, ENetOutgoingCommand * outgoingCommand)
+{
+    ++ peer -> packetsLost;
+
+    ENET_TRACE (host, ENET_TRACE_EVENT_COMMAND_RETRANSMITTED, command_retransmitted, peer -> incomingPeerID,
+                outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK, outgoingCommand -> reliableSequenceNumber, outgoingCommand -> sendAttempts);
+
+    if (peer -> compressionHistory != NULL)
+      enet_protocol_reset_compression_history (peer -> compressionHistory);
+
+    if (outgoingCommand -> packet != NULL)
+    {
+      peer -> reliableDataInTransit -= outgoingCommand -> fragmentLength;
+
+      if (peer -> congestionState != NULL && host -> congestionControl.loss != NULL)
+        host -> congestionControl.loss (peer -> congestionState, peer, outgoingCommand -> fragmentLength);
+
+      enet_peer_insert_outgoing_command (& peer -> outgoingSendReliableCommands, (ENetOutgoingCommand *) enet_list_remove (& outgoingCommand -> outgoingCommandList));
+    }
+    else
+      enet_peer_insert_outgoing_command (& peer -> outgoingCommands, (ENetOutgoingCommand *) enet_list_remove (& outgoingCommand -> outgoingCommandList));
+}
+
+/* Whether a reliable packet ran out of the retransmissions or the time it was given. It is only
+   given up on if the peer understands skips, as an older peer would wait for it forever. */
+static int
+enet_protocol_is_abandoned (ENetHost * host, ENetPeer * peer, const ENetOutgoingCommand * outgoingCommand)
+{
+    const ENetPacket * packet = outgoingCommand -> packet;
+
+    if (packet == NULL ||
+        outgoingCommand -> command.header.channelID >= peer -> channelCount ||
+        ! (peer -> protocolFeatures & ENET_PROTOCOL_FEATURE_SKIP))
+      return 0;
+
+    return (packet -> retransmitLimit != 0 && outgoingCommand -> sendAttempts > packet -> retransmitLimit) ||
+           (packet -> lifetime != 0 && ENET_TIME_DIFFERENCE (host -> serviceTime, outgoingCommand -> enqueueTime) >= packet -> lifetime);
+}
+
+/* Turns a reliable command into a skip holding its place in the channel, and releases its packet. */
+static void
+enet_protocol_skip_command (ENetHost * host, ENetPeer * peer, ENetOutgoingCommand * outgoingCommand)
+{
+    enet_uint16 startSequenceNumber = ENET_HOST_TO_NET_16 (outgoingCommand -> reliableSequenceNumber);
+    enet_uint32 fragmentCount = ENET_HOST_TO_NET_32 (1),
+                fragmentNumber = 0;
+
+    ++ host -> counters.drops [ENET_DROP_REASON_ABANDONED];
+
+    ENET_TRACE (host, ENET_TRACE_EVENT_COMMAND_DROPPED, command_dropped, peer -> incomingPeerID,
+                outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK, outgoingCommand -> reliableSequenceNumber, outgoingCommand -> unreliableSequenceNumber);
+
+    if ((outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_SEND_FRAGMENT)
+    {
+        startSequenceNumber = outgoingCommand -> command.sendFragment.startSequenceNumber;
+        fragmentCount = outgoingCommand -> command.sendFragment.fragmentCount;
+        fragmentNumber = outgoingCommand -> command.sendFragment.fragmentNumber;
+
+        enet_peer_release_fragment (outgoingCommand);
+    }
+
+    outgoingCommand -> command.header.command = ENET_PROTOCOL_COMMAND_SKIP | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
+    outgoingCommand -> command.skip.startSequenceNumber = startSequenceNumber;
+    outgoingCommand -> command.skip.fragmentCount = fragmentCount;
+    outgoingCommand -> command.skip.fragmentNumber = fragmentNumber;
+
+    -- outgoingCommand -> packet -> referenceCount;
+
+    if (outgoingCommand -> packet -> referenceCount == 0)
+      enet_packet_destroy (outgoingCommand -> packet);
+
+    outgoingCommand -> packet = NULL;
+    outgoingCommand -> fragmentOffset = 0;
+    outgoingCommand -> fragmentLength = 0;
+}
+
+/* Gives up on the reliable packet of a command, replacing every command of it not yet acknowledged
+   with a skip, so that the peer moves past the packet instead of holding up the channel for it.
+   While a fragment of the packet may still be in the datagram being built, whose buffers point into
+   the packet, the packet is kept and the command sent as it is, to be given up on in a later pass. */
+static void
+enet_protocol_abandon_packet (ENetHost * host, ENetPeer * peer, ENetOutgoingCommand * outgoingCommand)
+{
+    ENetPacket * packet = outgoingCommand -> packet;
+    enet_uint8 channelID = outgoingCommand -> command.header.channelID;
+    enet_uint16 startSequenceNumber = outgoingCommand -> command.sendFragment.startSequenceNumber;
     ENetListIterator currentCommand;
-    ENetProtocolCommand commandNumber;
-    int wasSent = 1;
 
-    for (currentCommand = enet_list_begin (& peer -> sentReliableCommands);
-         currentCommand != enet_list_end (& peer -> sentReliableCommands);
-         currentCommand = enet_list_next (currentCommand))
+    if ((outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_SEND_FRAGMENT)
     {
-       outgoingCommand = (ENetOutgoingCommand *) currentCommand;
-        
-       if (outgoingCommand -> reliableSequenceNumber == reliableSequenceNumber &&
-           outgoingCommand -> command.header.channelID == channelID)
-         break;
+        for (currentCommand = enet_list_begin (& peer -> sentReliableCommands);
+             currentCommand != enet_list_end (& peer -> sentReliableCommands);
+             currentCommand = enet_list_next (currentCommand))
+        {
+           ENetOutgoingCommand * fragment = (ENetOutgoingCommand *) currentCommand;
+
+           if (fragment -> packet == packet && fragment -> sentTime == host -> serviceTime)
+             return;
+        }
     }
 
-    if (currentCommand == enet_list_end (& peer -> sentReliableCommands))
+    if (host -> abandon != NULL)
+      host -> abandon (peer, packet);
+
+    if ((outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_SEND_FRAGMENT)
     {
-       outgoingCommand = enet_protocol_find_sent_reliable_command (& peer -> outgoingCommands, reliableSequenceNumber, channelID);
-       if (outgoingCommand == NULL)
-         outgoingCommand = enet_protocol_find_sent_reliable_command (& peer -> outgoingSendReliableCommands, reliableSequenceNumber, channelID);
+        for (currentCommand = enet_list_begin (& peer -> sentReliableCommands);
+             currentCommand != enet_list_end (& peer -> sentReliableCommands);
+             currentCommand = enet_list_next (currentCommand))
+        {
+           ENetOutgoingCommand * fragment = (ENetOutgoingCommand *) currentCommand;
 
-       wasSent = 0;
+           if (fragment -> packet != packet ||
+               fragment -> command.header.channelID != channelID ||
+               fragment -> command.sendFragment.startSequenceNumber != startSequenceNumber)
+             continue;
+
+           peer -> reliableDataInTransit -= fragment -> fragmentLength;
+
+           enet_protocol_skip_command (host, peer, fragment);
+        }
+
+        for (currentCommand = enet_list_begin (& peer -> outgoingSendReliableCommands);
+             currentCommand != enet_list_end (& peer -> outgoingSendReliableCommands);
+             currentCommand = enet_list_next (currentCommand))
+        {
+           ENetOutgoingCommand * fragment = (ENetOutgoingCommand *) currentCommand;
+
+           if (fragment == outgoingCommand ||
+               fragment -> packet != packet ||
+               fragment -> command.header.channelID != channelID ||
+               fragment -> command.sendFragment.startSequenceNumber != startSequenceNumber)
+             continue;
+
+           enet_protocol_skip_command (host, peer, fragment);
+        }
     }
 
-    if (outgoingCommand == NULL)
-      return ENET_PROTOCOL_COMMAND_NONE;
+    enet_protocol_skip_command (host, peer, outgoingCommand);
+}
+
+/* Resends the commands that several commands sent after them on their channel were acknowledged in place of,
+   rather than waiting out their retransmission timeouts, as a loss is far likelier than datagrams
+   overtaking each other that much. The timeout is left as is since the path is evidently fine. */
+static void
+enet_protocol_fast_retransmit (ENetHost * host, ENetPeer * peer)
+{
+    ENetOutgoingCommand * outgoingCommand;
+    ENetListIterator currentCommand;
+
+    currentCommand = enet_list_begin (& peer -> sentReliableCommands);
+
+    while (currentCommand != enet_list_end (& peer -> sentReliableCommands))
+    {
+       outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+
+       currentCommand = enet_list_next (currentCommand);
+
+       if (outgoingCommand -> command.header.channelID >= peer -> channelCount ||
+           outgoingCommand -> sendOrder >= peer -> channels [outgoingCommand -> command.header.channelID].acknowledgedSendOrders [ENET_PEER_FAST_RETRANSMIT_THRESHOLD - 1])
+         continue;
+
+       if (enet_protocol_is_mtu_probe (outgoingCommand))
+       {
+          enet_protocol_lose_mtu_probe (host, peer, outgoingCommand);
+
+          continue;
+       }
+
+       enet_protocol_retransmit_command (host, peer, outgoingCommand);
+    }
+}
+
+/* Releases a reliable command the peer acknowledged, found among the sent commands or, if it was
+   already queued again for retransmission, among the outgoing ones. */
+static ENetProtocolCommand
+enet_protocol_acknowledge_command (ENetPeer * peer, ENetOutgoingCommand * outgoingCommand, int wasSent, enet_uint32 roundTripTime)
+{
+    enet_uint16 reliableSequenceNumber = outgoingCommand -> reliableSequenceNumber;
+    enet_uint8 channelID = outgoingCommand -> command.header.channelID;
+    ENetProtocolCommand commandNumber;
+    int passedAcknowledged = 0;
 
     if (channelID < peer -> channelCount)
     {
        ENetChannel * channel = & peer -> channels [channelID];
        enet_uint16 reliableWindow = reliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
+
+       /* a command is presumed lost once enough commands sent after it on its channel were acknowledged */
+       if (wasSent && outgoingCommand -> sendOrder > channel -> acknowledgedSendOrders [ENET_PEER_FAST_RETRANSMIT_THRESHOLD - 1])
+       {
+          int i;
+
+          for (i = ENET_PEER_FAST_RETRANSMIT_THRESHOLD - 1; i > 0 && channel -> acknowledgedSendOrders [i - 1] < outgoingCommand -> sendOrder; -- i)
+            channel -> acknowledgedSendOrders [i] = channel -> acknowledgedSendOrders [i - 1];
+
+          channel -> acknowledgedSendOrders [i] = outgoingCommand -> sendOrder;
+
+          passedAcknowledged = 1;
+       }
+
        if (channel -> reliableWindows [reliableWindow] > 0)
        {
           -- channel -> reliableWindows [reliableWindow];
@@ -264,10 +688,31 @@ enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliabl
     
     enet_list_remove (& outgoingCommand -> outgoingCommandList);
 
+    ENET_TRACE (peer -> host, ENET_TRACE_EVENT_COMMAND_ACKNOWLEDGED, command_acknowledged, peer -> incomingPeerID, commandNumber, reliableSequenceNumber, roundTripTime);
+
+    if (wasSent)
+    {
+       enet_histogram_add (& peer -> histograms.retransmissions, outgoingCommand -> sendAttempts - 1);
+       enet_histogram_add (& peer -> host -> histograms.retransmissions, outgoingCommand -> sendAttempts - 1);
+    }
+
     if (outgoingCommand -> packet != NULL)
     {
        if (wasSent)
-         peer -> reliableDataInTransit -= outgoingCommand -> fragmentLength;
+       {
+          peer -> reliableDataInTransit -= outgoingCommand -> fragmentLength;
+
+          if (peer -> congestionState != NULL)
+            peer -> host -> congestionControl.acknowledge (peer -> congestionState, peer, outgoingCommand -> fragmentLength, roundTripTime);
+       }
+
+       if (enet_protocol_is_mtu_probe (outgoingCommand))
+         enet_protocol_confirm_mtu_probe (peer -> host, peer);
+       else
+       /* the packet is only delivered once no other fragment of it remains unacknowledged by the peer */
+       if ((commandNumber != ENET_PROTOCOL_COMMAND_SEND_FRAGMENT || enet_peer_release_fragment (outgoingCommand)) &&
+           peer -> host -> acknowledge != NULL)
+         peer -> host -> acknowledge (peer, outgoingCommand -> packet, roundTripTime);
 
        -- outgoingCommand -> packet -> referenceCount;
 
@@ -281,6 +726,13 @@ enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliabl
 
     enet_free (outgoingCommand);
 
+    /* sent reliable commands are kept in the order they were sent, so unless the oldest was sent before
+       the latest acknowledgements on the channel, none of them was passed */
+    if (passedAcknowledged &&
+        ! enet_list_empty (& peer -> sentReliableCommands) &&
+        ((ENetOutgoingCommand *) enet_list_front (& peer -> sentReliableCommands)) -> sendOrder < peer -> channels [channelID].acknowledgedSendOrders [ENET_PEER_FAST_RETRANSMIT_THRESHOLD - 1])
+      enet_protocol_fast_retransmit (peer -> host, peer);
+
     if (enet_list_empty (& peer -> sentReliableCommands))
       return commandNumber;
     
@@ -289,7 +741,40 @@ enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliabl
     peer -> nextTimeout = outgoingCommand -> sentTime + outgoingCommand -> roundTripTimeout;
 
     return commandNumber;
-} 
+}
+
+static ENetProtocolCommand
+enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliableSequenceNumber, enet_uint8 channelID, enet_uint32 roundTripTime)
+{
+    ENetOutgoingCommand * outgoingCommand = NULL;
+    ENetListIterator currentCommand;
+    int wasSent = 1;
+
+    for (currentCommand = enet_list_begin (& peer -> sentReliableCommands);
+         currentCommand != enet_list_end (& peer -> sentReliableCommands);
+         currentCommand = enet_list_next (currentCommand))
+    {
+       outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+        
+       if (outgoingCommand -> reliableSequenceNumber == reliableSequenceNumber &&
+           outgoingCommand -> command.header.channelID == channelID)
+         break;
+    }
+
+    if (currentCommand == enet_list_end (& peer -> sentReliableCommands))
+    {
+       outgoingCommand = enet_protocol_find_sent_reliable_command (& peer -> outgoingCommands, reliableSequenceNumber, channelID);
+       if (outgoingCommand == NULL)
+         outgoingCommand = enet_protocol_find_sent_reliable_command (& peer -> outgoingSendReliableCommands, reliableSequenceNumber, channelID);
+
+       wasSent = 0;
+    }
+
+    if (outgoingCommand == NULL)
+      return ENET_PROTOCOL_COMMAND_NONE;
+
+    return enet_protocol_acknowledge_command (peer, outgoingCommand, wasSent, roundTripTime);
+}
 
 static ENetPeer *
 enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENetProtocol * command)
@@ -337,10 +822,12 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
     if (peer -> channels == NULL)
       return NULL;
     peer -> channelCount = channelCount;
+    ENET_TRACE (host, ENET_TRACE_EVENT_PEER_STATE_CHANGED, peer_state_changed, peer -> incomingPeerID, peer -> state, ENET_PEER_STATE_ACKNOWLEDGING_CONNECT, 0);
     peer -> state = ENET_PEER_STATE_ACKNOWLEDGING_CONNECT;
+    enet_peer_congestion_create (peer);
     peer -> connectID = command -> connect.connectID;
     peer -> address = host -> receivedAddress;
-    peer -> mtu = host -> mtu;
+    peer -> mtu = ENET_MIN (ENET_MAX (host -> mtu, host -> maximumMtu), host -> packetDataSize);
     peer -> outgoingPeerID = ENET_NET_TO_HOST_16 (command -> connect.outgoingPeerID);
     peer -> incomingBandwidth = ENET_NET_TO_HOST_32 (command -> connect.incomingBandwidth);
     peer -> outgoingBandwidth = ENET_NET_TO_HOST_32 (command -> connect.outgoingBandwidth);
@@ -369,21 +856,41 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
         channel -> outgoingUnreliableSequenceNumber = 0;
         channel -> incomingReliableSequenceNumber = 0;
         channel -> incomingUnreliableSequenceNumber = 0;
+        channel -> acknowledgedReliableSequenceNumber = 0;
 
         enet_list_clear (& channel -> incomingReliableCommands);
         enet_list_clear (& channel -> incomingUnreliableCommands);
 
         channel -> usedReliableWindows = 0;
+        channel -> compressionYield = ENET_PEER_COMPRESSION_YIELD_SCALE;
+        channel -> flags = 0;
+        channel -> parityGroupLength = 0;
+        channel -> snapshots = NULL;
+        channel -> priority = 0;
+        channel -> weight = ENET_CHANNEL_DEFAULT_WEIGHT;
+        channel -> scheduleStart = 0;
+        channel -> scheduleFinish = 0;
+        channel -> supersedableCommand = NULL;
+        channel -> unorderedWindow = NULL;
+        memset (channel -> acknowledgedSendOrders, 0, sizeof (channel -> acknowledgedSendOrders));
         memset (channel -> reliableWindows, 0, sizeof (channel -> reliableWindows));
     }
 
     mtu = ENET_NET_TO_HOST_32 (command -> connect.mtu);
 
+    if (enet_protocol_agree_features (host, peer, mtu) < 0)
+    {
+        enet_peer_reset (peer);
+
+        return NULL;
+    }
+    mtu &= ENET_PROTOCOL_MTU_MASK;
+
     if (mtu < ENET_PROTOCOL_MINIMUM_MTU)
       mtu = ENET_PROTOCOL_MINIMUM_MTU;
     else
-    if (mtu > ENET_PROTOCOL_MAXIMUM_MTU)
-      mtu = ENET_PROTOCOL_MAXIMUM_MTU;
+    if (mtu > ENET_PROTOCOL_MAXIMUM_JUMBO_MTU)
+      mtu = ENET_PROTOCOL_MAXIMUM_JUMBO_MTU;
 
     if (mtu < peer -> mtu)
       peer -> mtu = mtu;
@@ -428,7 +935,7 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
     verifyCommand.verifyConnect.outgoingPeerID = ENET_HOST_TO_NET_16 (peer -> incomingPeerID);
     verifyCommand.verifyConnect.incomingSessionID = incomingSessionID;
     verifyCommand.verifyConnect.outgoingSessionID = outgoingSessionID;
-    verifyCommand.verifyConnect.mtu = ENET_HOST_TO_NET_32 (peer -> mtu);
+    verifyCommand.verifyConnect.mtu = ENET_HOST_TO_NET_32 (peer -> mtu | peer -> protocolFeatures);
     verifyCommand.verifyConnect.windowSize = ENET_HOST_TO_NET_32 (windowSize);
     verifyCommand.verifyConnect.channelCount = ENET_HOST_TO_NET_32 (channelCount);
     verifyCommand.verifyConnect.incomingBandwidth = ENET_HOST_TO_NET_32 (host -> incomingBandwidth);
@@ -440,6 +947,8 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
 
     enet_peer_queue_outgoing_command (peer, & verifyCommand, NULL, 0, 0);
 
+    enet_protocol_start_mtu_discovery (host, peer);
+
     return peer;
 }
 
@@ -489,7 +998,10 @@ enet_protocol_handle_send_unsequenced (ENetHost * host, ENetPeer * peer, const E
       unsequencedGroup += 0x10000;
 
     if (unsequencedGroup >= (enet_uint32) peer -> incomingUnsequencedGroup + ENET_PEER_FREE_UNSEQUENCED_WINDOWS * ENET_PEER_UNSEQUENCED_WINDOW_SIZE)
-      return 0;
+    {
+        ++ host -> counters.drops [ENET_DROP_REASON_OUTSIDE_WINDOW];
+        return 0;
+    }
 
     unsequencedGroup &= 0xFFFF;
 
@@ -501,7 +1013,10 @@ enet_protocol_handle_send_unsequenced (ENetHost * host, ENetPeer * peer, const E
     }
     else
     if (peer -> unsequencedWindow [index / 32] & (1u << (index % 32)))
-      return 0;
+    {
+        ++ host -> counters.drops [ENET_DROP_REASON_DUPLICATE];
+        return 0;
+    }
       
     if (enet_peer_queue_incoming_command (peer, command, (const enet_uint8 *) command + sizeof (ENetProtocolSendUnsequenced), dataLength, ENET_PACKET_FLAG_UNSEQUENCED, 0) == NULL)
       return -1;
@@ -568,7 +1083,11 @@ enet_protocol_handle_send_fragment (ENetHost * host, ENetPeer * peer, const ENet
       startWindow += ENET_PEER_RELIABLE_WINDOWS;
 
     if (startWindow < currentWindow || startWindow >= currentWindow + ENET_PEER_FREE_RELIABLE_WINDOWS - 1)
-      return 0;
+    {
+        /* a sequence number behind the current one was already delivered */
+        ++ host -> counters.drops [startSequenceNumber < channel -> incomingReliableSequenceNumber ? ENET_DROP_REASON_DUPLICATE : ENET_DROP_REASON_OUTSIDE_WINDOW];
+        return 0;
+    }
 
     fragmentNumber = ENET_NET_TO_HOST_32 (command -> sendFragment.fragmentNumber);
     fragmentCount = ENET_NET_TO_HOST_32 (command -> sendFragment.fragmentCount);
@@ -603,6 +1122,13 @@ enet_protocol_handle_send_fragment (ENetHost * host, ENetPeer * peer, const ENet
           if (incomingCommand -> reliableSequenceNumber < startSequenceNumber)
             break;
         
+          /* the fragments of an abandoned packet only fill in the gaps the sender did not skip */
+          if ((incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_SKIP)
+          {
+             if (fragmentCount != incomingCommand -> fragmentCount)
+               return -1;
+          }
+          else
           if ((incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_SEND_FRAGMENT ||
               totalLength != incomingCommand -> packet -> dataLength ||
               fragmentCount != incomingCommand -> fragmentCount)
@@ -612,18 +1138,289 @@ enet_protocol_handle_send_fragment (ENetHost * host, ENetPeer * peer, const ENet
           break;
        }
     }
- 
-    if (startCommand == NULL)
+ 
+    if (startCommand == NULL)
+    {
+       ENetProtocol hostCommand = * command;
+
+       hostCommand.header.reliableSequenceNumber = startSequenceNumber;
+
+       startCommand = enet_peer_queue_incoming_command (peer, & hostCommand, NULL, totalLength, ENET_PACKET_FLAG_RELIABLE, fragmentCount);
+       if (startCommand == NULL)
+         return -1;
+    }
+    
+    if ((startCommand -> fragments [fragmentNumber / 32] & (1u << (fragmentNumber % 32))) == 0)
+    {
+       -- startCommand -> fragmentsRemaining;
+
+       startCommand -> fragments [fragmentNumber / 32] |= (1u << (fragmentNumber % 32));
+
+       if ((startCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_SKIP)
+       {
+          if (fragmentOffset + fragmentLength > startCommand -> packet -> dataLength)
+            fragmentLength = startCommand -> packet -> dataLength - fragmentOffset;
+
+          memcpy (startCommand -> packet -> data + fragmentOffset,
+                  (enet_uint8 *) command + sizeof (ENetProtocolSendFragment),
+                  fragmentLength);
+       }
+
+        if (startCommand -> fragmentsRemaining <= 0)
+        {
+          enet_histogram_add (& peer -> histograms.reassemblyTime, ENET_TIME_DIFFERENCE (host -> serviceTime, startCommand -> receiveTime));
+          enet_histogram_add (& host -> histograms.reassemblyTime, ENET_TIME_DIFFERENCE (host -> serviceTime, startCommand -> receiveTime));
+
+          enet_peer_dispatch_incoming_reliable_commands (peer, channel, startCommand);
+        }
+    }
+    else
+      ++ host -> counters.drops [ENET_DROP_REASON_DUPLICATE];
+
+    return 0;
+}
+
+static int
+enet_protocol_handle_skip (ENetHost * host, ENetPeer * peer, const ENetProtocol * command)
+{
+    enet_uint32 fragmentNumber,
+           fragmentCount,
+           startSequenceNumber;
+    ENetChannel * channel;
+    enet_uint16 startWindow, currentWindow;
+    ENetListIterator currentCommand;
+    ENetIncomingCommand * startCommand = NULL;
+
+    if (command -> header.channelID >= peer -> channelCount ||
+        (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER) ||
+        ! (peer -> protocolFeatures & ENET_PROTOCOL_FEATURE_SKIP))
+      return -1;
+
+    channel = & peer -> channels [command -> header.channelID];
+    startSequenceNumber = ENET_NET_TO_HOST_16 (command -> skip.startSequenceNumber);
+    startWindow = startSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
+    currentWindow = channel -> incomingReliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
+
+    if (startSequenceNumber < channel -> incomingReliableSequenceNumber)
+      startWindow += ENET_PEER_RELIABLE_WINDOWS;
+
+    if (startWindow < currentWindow || startWindow >= currentWindow + ENET_PEER_FREE_RELIABLE_WINDOWS - 1)
+    {
+        /* the packet was delivered after all, or another of its skips already moved the channel past it */
+        ++ host -> counters.drops [startSequenceNumber < channel -> incomingReliableSequenceNumber ? ENET_DROP_REASON_DUPLICATE : ENET_DROP_REASON_OUTSIDE_WINDOW];
+        return 0;
+    }
+
+    /* the channel just got past the packet, or it was a single command already delivered ahead on an unordered channel */
+    if (startSequenceNumber == channel -> incomingReliableSequenceNumber ||
+        (channel -> unorderedWindow != NULL &&
+         (channel -> unorderedWindow [(startSequenceNumber % ENET_PEER_UNORDERED_WINDOW_SIZE) / 32] & (1u << (startSequenceNumber % 32)))))
+    {
+        ++ host -> counters.drops [ENET_DROP_REASON_DUPLICATE];
+        return 0;
+    }
+
+    fragmentNumber = ENET_NET_TO_HOST_32 (command -> skip.fragmentNumber);
+    fragmentCount = ENET_NET_TO_HOST_32 (command -> skip.fragmentCount);
+
+    if (fragmentCount > ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT ||
+        fragmentNumber >= fragmentCount ||
+        (enet_uint16) (command -> header.reliableSequenceNumber - startSequenceNumber) != fragmentNumber)
+      return -1;
+
+    for (currentCommand = enet_list_previous (enet_list_end (& channel -> incomingReliableCommands));
+         currentCommand != enet_list_end (& channel -> incomingReliableCommands);
+         currentCommand = enet_list_previous (currentCommand))
+    {
+       ENetIncomingCommand * incomingCommand = (ENetIncomingCommand *) currentCommand;
+
+       if (startSequenceNumber >= channel -> incomingReliableSequenceNumber)
+       {
+          if (incomingCommand -> reliableSequenceNumber < channel -> incomingReliableSequenceNumber)
+            continue;
+       }
+       else
+       if (incomingCommand -> reliableSequenceNumber >= channel -> incomingReliableSequenceNumber)
+         break;
+
+       if (incomingCommand -> reliableSequenceNumber <= startSequenceNumber)
+       {
+          if (incomingCommand -> reliableSequenceNumber < startSequenceNumber)
+            break;
+
+          /* the whole packet arrived before the sender gave up on it */
+          if ((incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_SEND_RELIABLE)
+          {
+             ++ host -> counters.drops [ENET_DROP_REASON_DUPLICATE];
+             return 0;
+          }
+
+          if (((incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_SEND_FRAGMENT &&
+                (incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_SKIP) ||
+              fragmentCount != incomingCommand -> fragmentCount)
+            return -1;
+
+          startCommand = incomingCommand;
+          break;
+       }
+    }
+
+    if (startCommand == NULL)
+    {
+       ENetProtocol hostCommand = * command;
+
+       hostCommand.header.reliableSequenceNumber = startSequenceNumber;
+
+       startCommand = enet_peer_queue_incoming_command (peer, & hostCommand, NULL, 0, ENET_PACKET_FLAG_RELIABLE, fragmentCount);
+       if (startCommand == NULL)
+         return -1;
+    }
+
+    /* the packet is discarded once the channel reaches it, whatever fragments of it arrived */
+    startCommand -> command.header.command = (startCommand -> command.header.command & ~ ENET_PROTOCOL_COMMAND_MASK) | ENET_PROTOCOL_COMMAND_SKIP;
+
+    if ((startCommand -> fragments [fragmentNumber / 32] & (1u << (fragmentNumber % 32))) == 0)
+    {
+       -- startCommand -> fragmentsRemaining;
+
+       startCommand -> fragments [fragmentNumber / 32] |= (1u << (fragmentNumber % 32));
+
+       if (startCommand -> fragmentsRemaining <= 0)
+         enet_peer_dispatch_incoming_reliable_commands (peer, channel, NULL);
+    }
+    else
+      ++ host -> counters.drops [ENET_DROP_REASON_DUPLICATE];
+
+    return 0;
+}
+
+static int
+enet_protocol_find_unreliable_fragments (ENetChannel * channel, enet_uint32 reliableSequenceNumber, enet_uint32 startSequenceNumber, enet_uint32 fragmentCount, enet_uint32 totalLength, ENetIncomingCommand ** startCommand)
+{
+    ENetListIterator currentCommand;
+
+    * startCommand = NULL;
+
+    for (currentCommand = enet_list_previous (enet_list_end (& channel -> incomingUnreliableCommands));
+         currentCommand != enet_list_end (& channel -> incomingUnreliableCommands);
+         currentCommand = enet_list_previous (currentCommand))
+    {
+       ENetIncomingCommand * incomingCommand = (ENetIncomingCommand *) currentCommand;
+
+       if (reliableSequenceNumber >= channel -> incomingReliableSequenceNumber)
+       {
+          if (incomingCommand -> reliableSequenceNumber < channel -> incomingReliableSequenceNumber)
+            continue;
+       }
+       else
+       if (incomingCommand -> reliableSequenceNumber >= channel -> incomingReliableSequenceNumber)
+         break;
+
+       if (incomingCommand -> reliableSequenceNumber < reliableSequenceNumber)
+         break;
+
+       if (incomingCommand -> reliableSequenceNumber > reliableSequenceNumber)
+         continue;
+
+       if (incomingCommand -> unreliableSequenceNumber <= startSequenceNumber)
+       {
+          if (incomingCommand -> unreliableSequenceNumber < startSequenceNumber)
+            break;
+
+          if ((incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT ||
+              totalLength != incomingCommand -> packet -> dataLength ||
+              fragmentCount != incomingCommand -> fragmentCount)
+            return -1;
+
+          * startCommand = incomingCommand;
+          break;
+       }
+    }
+
+    return 0;
+}
+
+static void
+enet_protocol_complete_unreliable_fragments (ENetHost * host, ENetPeer * peer, ENetChannel * channel, ENetIncomingCommand * startCommand)
+{
+    enet_histogram_add (& peer -> histograms.reassemblyTime, ENET_TIME_DIFFERENCE (host -> serviceTime, startCommand -> receiveTime));
+    enet_histogram_add (& host -> histograms.reassemblyTime, ENET_TIME_DIFFERENCE (host -> serviceTime, startCommand -> receiveTime));
+
+    enet_peer_dispatch_incoming_unreliable_commands (peer, channel, NULL);
+}
+
+static int
+enet_protocol_handle_send_unreliable_fragment (ENetHost * host, ENetPeer * peer, const ENetProtocol * command, enet_uint8 ** currentData)
+{
+    enet_uint32 fragmentNumber,
+           fragmentCount,
+           fragmentOffset,
+           fragmentLength,
+           reliableSequenceNumber,
+           startSequenceNumber,
+           totalLength;
+    enet_uint16 reliableWindow, currentWindow;
+    ENetChannel * channel;
+    ENetIncomingCommand * startCommand = NULL;
+
+    if (command -> header.channelID >= peer -> channelCount ||
+        (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER))
+      return -1;
+
+    fragmentLength = ENET_NET_TO_HOST_16 (command -> sendFragment.dataLength);
+    * currentData += fragmentLength;
+    if (fragmentLength <= 0 ||
+        fragmentLength > host -> maximumPacketSize ||
+        * currentData < host -> receivedData ||
+        * currentData > & host -> receivedData [host -> receivedDataLength])
+      return -1;
+
+    channel = & peer -> channels [command -> header.channelID];
+    reliableSequenceNumber = command -> header.reliableSequenceNumber;
+    startSequenceNumber = ENET_NET_TO_HOST_16 (command -> sendFragment.startSequenceNumber);
+
+    reliableWindow = reliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
+    currentWindow = channel -> incomingReliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
+
+    if (reliableSequenceNumber < channel -> incomingReliableSequenceNumber)
+      reliableWindow += ENET_PEER_RELIABLE_WINDOWS;
+
+    if (reliableWindow < currentWindow || reliableWindow >= currentWindow + ENET_PEER_FREE_RELIABLE_WINDOWS - 1)
+    {
+        ++ host -> counters.drops [reliableSequenceNumber < channel -> incomingReliableSequenceNumber ? ENET_DROP_REASON_DUPLICATE : ENET_DROP_REASON_OUTSIDE_WINDOW];
+        return 0;
+    }
+
+    if (reliableSequenceNumber == channel -> incomingReliableSequenceNumber &&
+        startSequenceNumber <= channel -> incomingUnreliableSequenceNumber)
     {
-       ENetProtocol hostCommand = * command;
+        ++ host -> counters.drops [ENET_DROP_REASON_DUPLICATE];
+        return 0;
+    }
 
-       hostCommand.header.reliableSequenceNumber = startSequenceNumber;
+    fragmentNumber = ENET_NET_TO_HOST_32 (command -> sendFragment.fragmentNumber);
+    fragmentCount = ENET_NET_TO_HOST_32 (command -> sendFragment.fragmentCount);
+    fragmentOffset = ENET_NET_TO_HOST_32 (command -> sendFragment.fragmentOffset);
+    totalLength = ENET_NET_TO_HOST_32 (command -> sendFragment.totalLength);
 
-       startCommand = enet_peer_queue_incoming_command (peer, & hostCommand, NULL, totalLength, ENET_PACKET_FLAG_RELIABLE, fragmentCount);
+    if (fragmentCount > ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT ||
+        fragmentNumber >= fragmentCount ||
+        totalLength > host -> maximumPacketSize ||
+        totalLength < fragmentCount ||
+        fragmentOffset >= totalLength ||
+        fragmentLength > totalLength - fragmentOffset)
+      return -1;
+
+    if (enet_protocol_find_unreliable_fragments (channel, reliableSequenceNumber, startSequenceNumber, fragmentCount, totalLength, & startCommand) < 0)
+      return -1;
+
+    if (startCommand == NULL)
+    {
+       startCommand = enet_peer_queue_incoming_command (peer, command, NULL, totalLength, ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT, fragmentCount);
        if (startCommand == NULL)
          return -1;
     }
-    
+
     if ((startCommand -> fragments [fragmentNumber / 32] & (1u << (fragmentNumber % 32))) == 0)
     {
        -- startCommand -> fragmentsRemaining;
@@ -638,42 +1435,52 @@ enet_protocol_handle_send_fragment (ENetHost * host, ENetPeer * peer, const ENet
                fragmentLength);
 
         if (startCommand -> fragmentsRemaining <= 0)
-          enet_peer_dispatch_incoming_reliable_commands (peer, channel, NULL);
+          enet_protocol_complete_unreliable_fragments (host, peer, channel, startCommand);
     }
+    else
+      ++ host -> counters.drops [ENET_DROP_REASON_DUPLICATE];
 
     return 0;
 }
 
 static int
-enet_protocol_handle_send_unreliable_fragment (ENetHost * host, ENetPeer * peer, const ENetProtocol * command, enet_uint8 ** currentData)
+enet_protocol_handle_send_parity_fragment (ENetHost * host, ENetPeer * peer, const ENetProtocol * command, enet_uint8 ** currentData)
 {
-    enet_uint32 fragmentNumber,
+    enet_uint32 groupNumber,
+           groupLength,
            fragmentCount,
+           fragmentNumber,
            fragmentOffset,
            fragmentLength,
+           missingFragment = 0,
+           missingCount = 0,
+           parityLength,
            reliableSequenceNumber,
            startSequenceNumber,
            totalLength;
     enet_uint16 reliableWindow, currentWindow;
     ENetChannel * channel;
-    ENetListIterator currentCommand;
     ENetIncomingCommand * startCommand = NULL;
+    const enet_uint8 * parity;
+    enet_uint8 * missingData;
+    size_t i;
 
     if (command -> header.channelID >= peer -> channelCount ||
-        (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER))
+        (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER) ||
+        ! (peer -> protocolFeatures & ENET_PROTOCOL_FEATURE_PARITY_FRAGMENT))
       return -1;
 
-    fragmentLength = ENET_NET_TO_HOST_16 (command -> sendFragment.dataLength);
-    * currentData += fragmentLength;
-    if (fragmentLength <= 0 ||
-        fragmentLength > host -> maximumPacketSize ||
+    parityLength = ENET_NET_TO_HOST_16 (command -> sendParityFragment.dataLength);
+    * currentData += parityLength;
+    if (parityLength <= 0 ||
+        parityLength > host -> maximumPacketSize ||
         * currentData < host -> receivedData ||
         * currentData > & host -> receivedData [host -> receivedDataLength])
       return -1;
 
     channel = & peer -> channels [command -> header.channelID];
     reliableSequenceNumber = command -> header.reliableSequenceNumber;
-    startSequenceNumber = ENET_NET_TO_HOST_16 (command -> sendFragment.startSequenceNumber);
+    startSequenceNumber = ENET_NET_TO_HOST_16 (command -> sendParityFragment.startSequenceNumber);
 
     reliableWindow = reliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
     currentWindow = channel -> incomingReliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
@@ -681,85 +1488,80 @@ enet_protocol_handle_send_unreliable_fragment (ENetHost * host, ENetPeer * peer,
     if (reliableSequenceNumber < channel -> incomingReliableSequenceNumber)
       reliableWindow += ENET_PEER_RELIABLE_WINDOWS;
 
-    if (reliableWindow < currentWindow || reliableWindow >= currentWindow + ENET_PEER_FREE_RELIABLE_WINDOWS - 1)
-      return 0;
-
-    if (reliableSequenceNumber == channel -> incomingReliableSequenceNumber &&
-        startSequenceNumber <= channel -> incomingUnreliableSequenceNumber)
+    /* parity for packets already delivered or discarded is simply no longer needed */
+    if (reliableWindow < currentWindow || reliableWindow >= currentWindow + ENET_PEER_FREE_RELIABLE_WINDOWS - 1 ||
+        (reliableSequenceNumber == channel -> incomingReliableSequenceNumber &&
+         startSequenceNumber <= channel -> incomingUnreliableSequenceNumber))
       return 0;
 
-    fragmentNumber = ENET_NET_TO_HOST_32 (command -> sendFragment.fragmentNumber);
-    fragmentCount = ENET_NET_TO_HOST_32 (command -> sendFragment.fragmentCount);
-    fragmentOffset = ENET_NET_TO_HOST_32 (command -> sendFragment.fragmentOffset);
-    totalLength = ENET_NET_TO_HOST_32 (command -> sendFragment.totalLength);
+    groupNumber = ENET_NET_TO_HOST_32 (command -> sendParityFragment.groupNumber);
+    groupLength = ENET_NET_TO_HOST_32 (command -> sendParityFragment.groupLength);
+    fragmentCount = ENET_NET_TO_HOST_32 (command -> sendParityFragment.fragmentCount);
+    totalLength = ENET_NET_TO_HOST_32 (command -> sendParityFragment.totalLength);
 
     if (fragmentCount > ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT ||
-        fragmentNumber >= fragmentCount ||
+        groupLength <= 0 ||
+        groupNumber >= fragmentCount ||
+        groupLength > fragmentCount - groupNumber ||
         totalLength > host -> maximumPacketSize ||
         totalLength < fragmentCount ||
-        fragmentOffset >= totalLength ||
-        fragmentLength > totalLength - fragmentOffset)
+        parityLength > totalLength)
       return -1;
 
-    for (currentCommand = enet_list_previous (enet_list_end (& channel -> incomingUnreliableCommands));
-         currentCommand != enet_list_end (& channel -> incomingUnreliableCommands);
-         currentCommand = enet_list_previous (currentCommand))
-    {
-       ENetIncomingCommand * incomingCommand = (ENetIncomingCommand *) currentCommand;
+    if (enet_protocol_find_unreliable_fragments (channel, reliableSequenceNumber, startSequenceNumber, fragmentCount, totalLength, & startCommand) < 0)
+      return -1;
 
-       if (reliableSequenceNumber >= channel -> incomingReliableSequenceNumber)
-       {
-          if (incomingCommand -> reliableSequenceNumber < channel -> incomingReliableSequenceNumber)
-            continue;
-       }
-       else
-       if (incomingCommand -> reliableSequenceNumber >= channel -> incomingReliableSequenceNumber)
-         break;
+    /* a packet none of whose fragments arrived yet cannot be rebuilt from a parity fragment, and
+       parity arriving ahead of the rest of its group is not kept for later, as the sender follows
+       each group with its parity and datagrams seldom overtake each other */
+    if (startCommand == NULL)
+      return 0;
 
-       if (incomingCommand -> reliableSequenceNumber < reliableSequenceNumber)
-         break;
+    for (fragmentNumber = groupNumber; fragmentNumber < groupNumber + groupLength; ++ fragmentNumber)
+      if ((startCommand -> fragments [fragmentNumber / 32] & (1u << (fragmentNumber % 32))) == 0)
+      {
+         missingFragment = fragmentNumber;
+         ++ missingCount;
+      }
 
-       if (incomingCommand -> reliableSequenceNumber > reliableSequenceNumber)
-         continue;
+    if (missingCount != 1)
+      return 0;
 
-       if (incomingCommand -> unreliableSequenceNumber <= startSequenceNumber)
-       {
-          if (incomingCommand -> unreliableSequenceNumber < startSequenceNumber)
-            break;
+    /* every fragment but the last of a packet is as long as the first of its group, so the
+       parity length gives the offsets, except for a group of only the shorter last fragment */
+    if (groupLength == 1 && missingFragment == fragmentCount - 1)
+      fragmentOffset = totalLength - parityLength;
+    else
+    if (missingFragment > (totalLength - 1) / parityLength)
+      return -1;
+    else
+      fragmentOffset = missingFragment * parityLength;
 
-          if ((incomingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT ||
-              totalLength != incomingCommand -> packet -> dataLength ||
-              fragmentCount != incomingCommand -> fragmentCount)
-            return -1;
+    fragmentLength = ENET_MIN (parityLength, totalLength - fragmentOffset);
+    missingData = startCommand -> packet -> data + fragmentOffset;
+    parity = (const enet_uint8 *) command + sizeof (ENetProtocolSendParityFragment);
 
-          startCommand = incomingCommand;
-          break;
-       }
-    }
+    memcpy (missingData, parity, fragmentLength);
 
-    if (startCommand == NULL)
+    for (fragmentNumber = groupNumber; fragmentNumber < groupNumber + groupLength; ++ fragmentNumber)
     {
-       startCommand = enet_peer_queue_incoming_command (peer, command, NULL, totalLength, ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT, fragmentCount);
-       if (startCommand == NULL)
-         return -1;
-    }
+       const enet_uint8 * fragmentData = startCommand -> packet -> data + fragmentNumber * parityLength;
 
-    if ((startCommand -> fragments [fragmentNumber / 32] & (1u << (fragmentNumber % 32))) == 0)
-    {
-       -- startCommand -> fragmentsRemaining;
+       if (fragmentNumber == missingFragment)
+         continue;
 
-       startCommand -> fragments [fragmentNumber / 32] |= (1u << (fragmentNumber % 32));
+       for (i = 0; i < fragmentLength && fragmentNumber * parityLength + i < totalLength; ++ i)
+         missingData [i] ^= fragmentData [i];
+    }
 
-       if (fragmentOffset + fragmentLength > startCommand -> packet -> dataLength)
-         fragmentLength = startCommand -> packet -> dataLength - fragmentOffset;
+    -- startCommand -> fragmentsRemaining;
 
-       memcpy (startCommand -> packet -> data + fragmentOffset,
-               (enet_uint8 *) command + sizeof (ENetProtocolSendFragment),
-               fragmentLength);
+    startCommand -> fragments [missingFragment / 32] |= (1u << (missingFragment % 32));
 
-        if (startCommand -> fragmentsRemaining <= 0)
-          enet_peer_dispatch_incoming_unreliable_commands (peer, channel, NULL);
-    }
+    ++ host -> counters.recoveredFragments;
+
+    if (startCommand -> fragmentsRemaining <= 0)
+      enet_protocol_complete_unreliable_fragments (host, peer, channel, startCommand);
 
     return 0;
 }
@@ -849,18 +1651,13 @@ enet_protocol_handle_disconnect (ENetHost * host, ENetPeer * peer, const ENetPro
     return 0;
 }
 
-static int
-enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer * peer, const ENetProtocol * command)
+static enet_uint32
+enet_protocol_update_round_trip_time (ENetHost * host, ENetPeer * peer, enet_uint16 sentTime, enet_uint32 acknowledgementDelay)
 {
     enet_uint32 roundTripTime,
-           receivedSentTime,
-           receivedReliableSequenceNumber;
-    ENetProtocolCommand commandNumber;
-
-    if (peer -> state == ENET_PEER_STATE_DISCONNECTED || peer -> state == ENET_PEER_STATE_ZOMBIE)
-      return 0;
+           receivedSentTime;
 
-    receivedSentTime = ENET_NET_TO_HOST_16 (command -> acknowledge.receivedSentTime);
+    receivedSentTime = sentTime;
     receivedSentTime |= host -> serviceTime & 0xFFFF0000;
     if ((receivedSentTime & 0x8000) > (host -> serviceTime & 0x8000))
         receivedSentTime -= 0x10000;
@@ -869,11 +1666,20 @@ enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer *
       return 0;
 
     roundTripTime = ENET_TIME_DIFFERENCE (host -> serviceTime, receivedSentTime);
-    roundTripTime = ENET_MAX (roundTripTime, 1);
+    roundTripTime = roundTripTime > acknowledgementDelay ? roundTripTime - acknowledgementDelay : 1;
+
+    enet_histogram_add (& peer -> histograms.roundTripTime, roundTripTime);
+    enet_histogram_add (& host -> histograms.roundTripTime, roundTripTime);
 
     if (peer -> lastReceiveTime > 0)
     {
-       enet_peer_throttle (peer, roundTripTime);
+       enet_uint32 packetThrottle = peer -> packetThrottle;
+
+       if (peer -> congestionState == NULL)
+         enet_peer_throttle (peer, roundTripTime);
+
+       if (peer -> packetThrottle != packetThrottle)
+         ENET_TRACE (host, ENET_TRACE_EVENT_THROTTLE_CHANGED, throttle_changed, peer -> incomingPeerID, packetThrottle, peer -> packetThrottle, roundTripTime);
 
        peer -> roundTripTimeVariance -= peer -> roundTripTimeVariance / 4;
 
@@ -915,10 +1721,12 @@ enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer *
     peer -> lastReceiveTime = ENET_MAX (host -> serviceTime, 1);
     peer -> earliestTimeout = 0;
 
-    receivedReliableSequenceNumber = ENET_NET_TO_HOST_16 (command -> acknowledge.receivedReliableSequenceNumber);
-
-    commandNumber = enet_protocol_remove_sent_reliable_command (peer, receivedReliableSequenceNumber, command -> header.channelID);
+    return roundTripTime;
+}
 
+static int
+enet_protocol_complete_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer * peer, ENetProtocolCommand commandNumber)
+{
     switch (peer -> state)
     {
     case ENET_PEER_STATE_ACKNOWLEDGING_CONNECT:
@@ -947,6 +1755,134 @@ enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer *
     return 0;
 }
 
+static int
+enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer * peer, const ENetProtocol * command)
+{
+    enet_uint32 roundTripTime,
+           receivedReliableSequenceNumber;
+    ENetProtocolCommand commandNumber;
+
+    if (peer -> state == ENET_PEER_STATE_DISCONNECTED || peer -> state == ENET_PEER_STATE_ZOMBIE)
+      return 0;
+
+    roundTripTime = enet_protocol_update_round_trip_time (host, peer, ENET_NET_TO_HOST_16 (command -> acknowledge.receivedSentTime), 0);
+    if (roundTripTime == 0)
+      return 0;
+
+    receivedReliableSequenceNumber = ENET_NET_TO_HOST_16 (command -> acknowledge.receivedReliableSequenceNumber);
+
+    commandNumber = enet_protocol_remove_sent_reliable_command (peer, receivedReliableSequenceNumber, command -> header.channelID, roundTripTime);
+
+    if (peer -> compressionHistory != NULL)
+      enet_protocol_acknowledge_compression_history (peer -> compressionHistory, command -> header.channelID, receivedReliableSequenceNumber, ENET_NET_TO_HOST_16 (command -> acknowledge.receivedSentTime));
+
+    return enet_protocol_complete_acknowledge (host, event, peer, commandNumber);
+}
+
+/* Moves the previously sent reliable commands of a list that a range acknowledgement covers to the end
+   of another list: those within the range itself, and those flagged in the mask past the gap after it. */
+static size_t
+enet_protocol_take_acknowledged_commands (ENetList * list, ENetList * acknowledgedCommands, const ENetProtocol * command, enet_uint32 rangeLength, enet_uint32 receivedMask)
+{
+    ENetListIterator currentCommand;
+    size_t acknowledged = 0;
+
+    for (currentCommand = enet_list_begin (list);
+         currentCommand != enet_list_end (list);)
+    {
+       ENetOutgoingCommand * outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+       enet_uint16 offset = outgoingCommand -> reliableSequenceNumber - command -> header.reliableSequenceNumber;
+
+       currentCommand = enet_list_next (currentCommand);
+
+       if (! (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE) ||
+           outgoingCommand -> sendAttempts < 1 ||
+           outgoingCommand -> command.header.channelID != command -> header.channelID)
+         continue;
+
+       if (offset >= rangeLength &&
+           (offset == rangeLength || offset - rangeLength - 1 >= 32 || ! (receivedMask & (1u << (offset - rangeLength - 1)))))
+         continue;
+
+       enet_list_insert (enet_list_end (acknowledgedCommands), enet_list_remove (& outgoingCommand -> outgoingCommandList));
+
+       ++ acknowledged;
+    }
+
+    return acknowledged;
+}
+
+static void
+enet_protocol_acknowledge_in_range (ENetPeer * peer, ENetOutgoingCommand * outgoingCommand, int wasSent, enet_uint32 roundTripTime, ENetProtocolCommand * commandNumber)
+{
+    ENetProtocolCommand removedCommand = enet_protocol_acknowledge_command (peer, outgoingCommand, wasSent, roundTripTime);
+
+    /* the handshake and disconnection only proceed on acknowledgement of their own commands, which takes precedence */
+    if (removedCommand != ENET_PROTOCOL_COMMAND_NONE &&
+        * commandNumber != ENET_PROTOCOL_COMMAND_VERIFY_CONNECT &&
+        * commandNumber != ENET_PROTOCOL_COMMAND_DISCONNECT)
+      * commandNumber = removedCommand;
+}
+
+static int
+enet_protocol_handle_acknowledge_range (ENetHost * host, ENetEvent * event, ENetPeer * peer, const ENetProtocol * command)
+{
+    enet_uint32 roundTripTime,
+           rangeLength,
+           receivedMask,
+           acknowledgementDelay,
+           mask;
+    enet_uint16 receivedSentTime;
+    ENetProtocolCommand commandNumber = ENET_PROTOCOL_COMMAND_NONE;
+    ENetList acknowledgedCommands;
+    size_t acknowledged, sentAcknowledged;
+
+    if (peer -> state == ENET_PEER_STATE_DISCONNECTED || peer -> state == ENET_PEER_STATE_ZOMBIE)
+      return 0;
+
+    rangeLength = ENET_NET_TO_HOST_16 (command -> acknowledgeRange.rangeLength);
+    if (! (peer -> protocolFeatures & ENET_PROTOCOL_FEATURE_ACKNOWLEDGE_RANGE) || rangeLength == 0 || rangeLength > ENET_PEER_ACKNOWLEDGE_RANGE_SIZE)
+      return -1;
+
+    receivedSentTime = ENET_NET_TO_HOST_16 (command -> acknowledgeRange.receivedSentTime);
+    acknowledgementDelay = ENET_NET_TO_HOST_16 (command -> acknowledgeRange.acknowledgementDelay);
+    roundTripTime = enet_protocol_update_round_trip_time (host, peer, receivedSentTime, acknowledgementDelay);
+    if (roundTripTime == 0)
+      return 0;
+
+    /* the round trip time excludes the delay, so retransmission waits for it separately, tracking its peaks */
+    if (acknowledgementDelay >= peer -> remoteAcknowledgementDelay)
+      peer -> remoteAcknowledgementDelay = acknowledgementDelay;
+    else
+      peer -> remoteAcknowledgementDelay -= (peer -> remoteAcknowledgementDelay - acknowledgementDelay) / 8;
+
+    /* the sent commands are walked once for the whole range, and the queues of commands awaiting
+       retransmission only if some acknowledged sequence number was not found among them */
+    receivedMask = ENET_NET_TO_HOST_32 (command -> acknowledgeRange.receivedMask);
+    for (acknowledged = rangeLength, mask = receivedMask; mask != 0; mask >>= 1)
+      acknowledged += mask & 1;
+
+    enet_list_clear (& acknowledgedCommands);
+
+    sentAcknowledged = enet_protocol_take_acknowledged_commands (& peer -> sentReliableCommands, & acknowledgedCommands, command, rangeLength, receivedMask);
+    while (! enet_list_empty (& acknowledgedCommands))
+      enet_protocol_acknowledge_in_range (peer, (ENetOutgoingCommand *) enet_list_front (& acknowledgedCommands), 1, roundTripTime, & commandNumber);
+
+    if (sentAcknowledged < acknowledged)
+    {
+       enet_protocol_take_acknowledged_commands (& peer -> outgoingCommands, & acknowledgedCommands, command, rangeLength, receivedMask);
+       enet_protocol_take_acknowledged_commands (& peer -> outgoingSendReliableCommands, & acknowledgedCommands, command, rangeLength, receivedMask);
+       while (! enet_list_empty (& acknowledgedCommands))
+         enet_protocol_acknowledge_in_range (peer, (ENetOutgoingCommand *) enet_list_front (& acknowledgedCommands), 0, roundTripTime, & commandNumber);
+    }
+
+    /* only the first command of the range had its sent time echoed, so only its datagram is known to have arrived */
+    if (peer -> compressionHistory != NULL)
+      enet_protocol_acknowledge_compression_history (peer -> compressionHistory, command -> header.channelID, command -> header.reliableSequenceNumber, receivedSentTime);
+
+    return enet_protocol_complete_acknowledge (host, event, peer, commandNumber);
+}
+
 static int
 enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPeer * peer, const ENetProtocol * command)
 {
@@ -971,7 +1907,7 @@ enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPee
         return -1;
     }
 
-    enet_protocol_remove_sent_reliable_command (peer, 1, 0xFF);
+    enet_protocol_remove_sent_reliable_command (peer, 1, 0xFF, 0);
     
     if (channelCount < peer -> channelCount)
       peer -> channelCount = channelCount;
@@ -982,15 +1918,27 @@ enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPee
 
     mtu = ENET_NET_TO_HOST_32 (command -> verifyConnect.mtu);
 
+    if (enet_protocol_agree_features (host, peer, mtu) < 0)
+    {
+        peer -> eventData = 0;
+
+        enet_protocol_dispatch_state (host, peer, ENET_PEER_STATE_ZOMBIE);
+
+        return -1;
+    }
+    mtu &= ENET_PROTOCOL_MTU_MASK;
+
     if (mtu < ENET_PROTOCOL_MINIMUM_MTU)
       mtu = ENET_PROTOCOL_MINIMUM_MTU;
     else 
-    if (mtu > ENET_PROTOCOL_MAXIMUM_MTU)
-      mtu = ENET_PROTOCOL_MAXIMUM_MTU;
+    if (mtu > ENET_PROTOCOL_MAXIMUM_JUMBO_MTU)
+      mtu = ENET_PROTOCOL_MAXIMUM_JUMBO_MTU;
 
     if (mtu < peer -> mtu)
       peer -> mtu = mtu;
 
+    enet_protocol_start_mtu_discovery (host, peer);
+
     windowSize = ENET_NET_TO_HOST_32 (command -> verifyConnect.windowSize);
 
     if (windowSize < ENET_PROTOCOL_MINIMUM_WINDOW_SIZE)
@@ -1009,6 +1957,52 @@ enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPee
     return 0;
 }
 
+static size_t
+enet_protocol_decompress_with_history (ENetHost * host, ENetPeer * peer, size_t headerSize, enet_uint8 * number)
+{
+    const enet_uint8 * inData = host -> receivedData + headerSize;
+    size_t inLength = host -> receivedDataLength - headerSize, i;
+
+    if (inLength <= 2)
+      return 0;
+
+    * number = inData [0];
+
+    if (inData [1] == ENET_PROTOCOL_COMPRESSION_HISTORY_STORED)
+    {
+        if (inLength - 2 > host -> packetDataSize - headerSize)
+          return 0;
+
+        memcpy (host -> packetData [1] + headerSize, inData + 2, inLength - 2);
+        return inLength - 2;
+    }
+
+    if (inData [1] == 0)
+      return host -> compressor.decompress (host -> compressor.context,
+                                    inData + 2,
+                                    inLength - 2,
+                                    host -> packetData [1] + headerSize,
+                                    host -> packetDataSize - headerSize);
+
+    if (host -> compressor.decompressWithDictionary == NULL)
+      return 0;
+
+    for (i = 0; i < ENET_PEER_COMPRESSION_HISTORY; ++ i)
+    {
+        const ENetCompressionRecord * dictionary = & peer -> compressionHistory -> incomingRecords [i];
+        if (dictionary -> number == inData [1])
+          return host -> compressor.decompressWithDictionary (host -> compressor.context,
+                                    dictionary -> data,
+                                    dictionary -> dataLength,
+                                    inData + 2,
+                                    inLength - 2,
+                                    host -> packetData [1] + headerSize,
+                                    host -> packetDataSize - headerSize);
+    }
+
+    return 0;
+}
+
 static int
 enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
 {
@@ -1018,10 +2012,13 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
     enet_uint8 * currentData;
     size_t headerSize;
     enet_uint16 peerID, flags;
-    enet_uint8 sessionID;
+    enet_uint8 sessionID, historyNumber = 0;
 
     if (host -> receivedDataLength < ENET_OFFSETOF(ENetProtocolHeader, sentTime))
-      return 0;
+    {
+       ++ host -> counters.drops [ENET_DROP_REASON_TRUNCATED];
+       return 0;
+    }
 
     header = (ENetProtocolHeader *) host -> receivedData;
 
@@ -1038,7 +2035,10 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
       peer = NULL;
     else
     if (peerID >= host -> peerCount)
-      return 0;
+    {
+       ++ host -> counters.drops [ENET_DROP_REASON_BAD_PEER_ID];
+       return 0;
+    }
     else
     {
        peer = & host -> peers [peerID];
@@ -1050,22 +2050,34 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
              peer -> address.host != ENET_HOST_BROADCAST) ||
            (peer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_PEER_ID &&
             sessionID != peer -> incomingSessionID))
-         return 0;
+       {
+          ++ host -> counters.drops [ENET_DROP_REASON_SESSION_MISMATCH];
+          return 0;
+       }
     }
  
     if (flags & ENET_PROTOCOL_HEADER_FLAG_COMPRESSED)
     {
         size_t originalSize;
         if (host -> compressor.context == NULL || host -> compressor.decompress == NULL)
-          return 0;
+        {
+            ++ host -> counters.drops [ENET_DROP_REASON_DECOMPRESS_FAILED];
+            return 0;
+        }
 
+        if (peer != NULL && peer -> compressionHistory != NULL)
+          originalSize = enet_protocol_decompress_with_history (host, peer, headerSize, & historyNumber);
+        else
         originalSize = host -> compressor.decompress (host -> compressor.context,
                                     host -> receivedData + headerSize, 
                                     host -> receivedDataLength - headerSize, 
                                     host -> packetData [1] + headerSize, 
-                                    sizeof (host -> packetData [1]) - headerSize);
-        if (originalSize <= 0 || originalSize > sizeof (host -> packetData [1]) - headerSize)
-          return 0;
+                                    host -> packetDataSize - headerSize);
+        if (originalSize <= 0 || originalSize > host -> packetDataSize - headerSize)
+        {
+            ++ host -> counters.drops [ENET_DROP_REASON_DECOMPRESS_FAILED];
+            return 0;
+        }
 
         memcpy (host -> packetData [1], header, headerSize);
         host -> receivedData = host -> packetData [1];
@@ -1087,8 +2099,14 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
         buffer.dataLength = host -> receivedDataLength;
 
         if (host -> checksum (& buffer, 1) != desiredChecksum)
-          return 0;
+        {
+            ++ host -> counters.drops [ENET_DROP_REASON_CHECKSUM_FAILED];
+            return 0;
+        }
     }
+
+    if (historyNumber != 0)
+      enet_protocol_store_compression_history (peer -> compressionHistory, historyNumber, host -> receivedData + headerSize, host -> receivedDataLength - headerSize);
        
     if (peer != NULL)
     {
@@ -1106,21 +2124,27 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
 
        command = (ENetProtocol *) currentData;
 
-       if (currentData + sizeof (ENetProtocolCommandHeader) > & host -> receivedData [host -> receivedDataLength])
+       /* the rest of a path MTU probe is padding */
+       if (peer != NULL && * currentData == ENET_PROTOCOL_COMMAND_NONE)
          break;
 
+       if (currentData + sizeof (ENetProtocolCommandHeader) > & host -> receivedData [host -> receivedDataLength])
+         goto commandError;
+
        commandNumber = command -> header.command & ENET_PROTOCOL_COMMAND_MASK;
        if (commandNumber >= ENET_PROTOCOL_COMMAND_COUNT) 
-         break;
+         goto commandError;
        
        commandSize = commandSizes [commandNumber];
        if (commandSize == 0 || currentData + commandSize > & host -> receivedData [host -> receivedDataLength])
-         break;
+         goto commandError;
 
        currentData += commandSize;
 
+       ++ host -> counters.receivedCommands [commandNumber];
+
        if (peer == NULL && commandNumber != ENET_PROTOCOL_COMMAND_CONNECT)
-         break;
+         goto commandError;
          
        command -> header.reliableSequenceNumber = ENET_NET_TO_HOST_16 (command -> header.reliableSequenceNumber);
 
@@ -1189,6 +2213,21 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
             goto commandError;
           break;
 
+       case ENET_PROTOCOL_COMMAND_ACKNOWLEDGE_RANGE:
+          if (enet_protocol_handle_acknowledge_range (host, event, peer, command))
+            goto commandError;
+          break;
+
+       case ENET_PROTOCOL_COMMAND_SEND_PARITY_FRAGMENT:
+          if (enet_protocol_handle_send_parity_fragment (host, peer, command, & currentData))
+            goto commandError;
+          break;
+
+       case ENET_PROTOCOL_COMMAND_SKIP:
+          if (enet_protocol_handle_skip (host, peer, command))
+            goto commandError;
+          break;
+
        default:
           goto commandError;
        }
@@ -1223,7 +2262,14 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
        }
     }
 
+    if (event != NULL && event -> type != ENET_EVENT_TYPE_NONE)
+      return 1;
+
+    return 0;
+
 commandError:
+    ++ host -> counters.drops [ENET_DROP_REASON_REJECTED_COMMAND];
+
     if (event != NULL && event -> type != ENET_EVENT_TYPE_NONE)
       return 1;
 
@@ -1235,13 +2281,28 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
 {
     int packets;
 
+    while (enet_host_impairment_release (host))
+    {
+       switch (enet_protocol_handle_incoming_commands (host, event))
+       {
+       case 1:
+          return 1;
+
+       case -1:
+          return -1;
+
+       default:
+          break;
+       }
+    }
+
     for (packets = 0; packets < 256; ++ packets)
     {
        int receivedLength;
        ENetBuffer buffer;
 
        buffer.data = host -> packetData [0];
-       buffer.dataLength = sizeof (host -> packetData [0]);
+       buffer.dataLength = host -> packetDataSize;
 
        receivedLength = enet_socket_receive (host -> socket,
                                              & host -> receivedAddress,
@@ -1259,9 +2320,13 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
 
        host -> receivedData = host -> packetData [0];
        host -> receivedDataLength = receivedLength;
+
+       ENET_TRACE (host, ENET_TRACE_EVENT_DATAGRAM_RECEIVED, datagram_received, 0xFFFF, receivedLength, host -> receivedAddress.host, host -> receivedAddress.port);
       
        host -> totalReceivedData += receivedLength;
        host -> totalReceivedPackets ++;
+       host -> counters.receivedData += receivedLength;
+       ++ host -> counters.receivedDatagrams;
 
        if (host -> intercept != NULL)
        {
@@ -1297,6 +2362,72 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
     return 0;
 }
 
+/* Fills in a range acknowledgement for the first queued acknowledgement and every other one on its
+   channel that the range and its mask cover, removing them from the queue. Acknowledgements are
+   queued as datagrams arrive, so the first echoes the datagram held back the longest, whose delay
+   both corrects the round trip time and bounds how long the peer should wait before retransmitting. */
+static void
+enet_protocol_build_acknowledge_range (ENetHost * host, ENetPeer * peer, ENetProtocol * command)
+{
+    ENetAcknowledgement * acknowledgement = (ENetAcknowledgement *) enet_list_front (& peer -> acknowledgements);
+    ENetListIterator currentAcknowledgement;
+    enet_uint32 received [ENET_PEER_ACKNOWLEDGE_RANGE_SIZE / 32],
+                rangeLength = 0,
+                receivedMask = 0,
+                offset;
+    enet_uint16 firstSequenceNumber = acknowledgement -> command.header.reliableSequenceNumber,
+                sentTime = acknowledgement -> sentTime;
+    enet_uint32 delay = ENET_TIME_DIFFERENCE (host -> serviceTime, acknowledgement -> receivedTime);
+    enet_uint8 channelID = acknowledgement -> command.header.channelID;
+
+    memset (received, 0, sizeof (received));
+
+    for (currentAcknowledgement = enet_list_begin (& peer -> acknowledgements);
+         currentAcknowledgement != enet_list_end (& peer -> acknowledgements);
+         currentAcknowledgement = enet_list_next (currentAcknowledgement))
+    {
+       acknowledgement = (ENetAcknowledgement *) currentAcknowledgement;
+
+       offset = (enet_uint16) (acknowledgement -> command.header.reliableSequenceNumber - firstSequenceNumber);
+       if (acknowledgement -> command.header.channelID == channelID && offset < ENET_PEER_ACKNOWLEDGE_RANGE_SIZE)
+         received [offset / 32] |= 1u << (offset % 32);
+    }
+
+    while (rangeLength < ENET_PEER_ACKNOWLEDGE_RANGE_SIZE && (received [rangeLength / 32] & (1u << (rangeLength % 32))))
+      ++ rangeLength;
+
+    for (offset = rangeLength + 1; offset <= rangeLength + 32 && offset < ENET_PEER_ACKNOWLEDGE_RANGE_SIZE; ++ offset)
+      if (received [offset / 32] & (1u << (offset % 32)))
+        receivedMask |= 1u << (offset - rangeLength - 1);
+
+    currentAcknowledgement = enet_list_begin (& peer -> acknowledgements);
+
+    while (currentAcknowledgement != enet_list_end (& peer -> acknowledgements))
+    {
+       acknowledgement = (ENetAcknowledgement *) currentAcknowledgement;
+
+       currentAcknowledgement = enet_list_next (currentAcknowledgement);
+
+       offset = (enet_uint16) (acknowledgement -> command.header.reliableSequenceNumber - firstSequenceNumber);
+       if (acknowledgement -> command.header.channelID != channelID || offset > rangeLength + 32 || offset >= ENET_PEER_ACKNOWLEDGE_RANGE_SIZE)
+         continue;
+
+       if ((acknowledgement -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_DISCONNECT)
+         enet_protocol_dispatch_state (host, peer, ENET_PEER_STATE_ZOMBIE);
+
+       enet_list_remove (& acknowledgement -> acknowledgementList);
+       enet_free (acknowledgement);
+    }
+
+    command -> header.command = ENET_PROTOCOL_COMMAND_ACKNOWLEDGE_RANGE;
+    command -> header.channelID = channelID;
+    command -> header.reliableSequenceNumber = ENET_HOST_TO_NET_16 (firstSequenceNumber);
+    command -> acknowledgeRange.receivedSentTime = ENET_HOST_TO_NET_16 (sentTime);
+    command -> acknowledgeRange.rangeLength = ENET_HOST_TO_NET_16 ((enet_uint16) rangeLength);
+    command -> acknowledgeRange.receivedMask = ENET_HOST_TO_NET_32 (receivedMask);
+    command -> acknowledgeRange.acknowledgementDelay = ENET_HOST_TO_NET_16 ((enet_uint16) ENET_MIN (delay, 0xFFFF));
+}
+
 static void
 enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
 {
@@ -1305,6 +2436,7 @@ enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
     ENetAcknowledgement * acknowledgement;
     ENetListIterator currentAcknowledgement;
     enet_uint16 reliableSequenceNumber;
+    size_t commandSize = (peer -> protocolFeatures & ENET_PROTOCOL_FEATURE_ACKNOWLEDGE_RANGE) ? sizeof (ENetProtocolAcknowledgeRange) : sizeof (ENetProtocolAcknowledge);
  
     currentAcknowledgement = enet_list_begin (& peer -> acknowledgements);
          
@@ -1312,22 +2444,33 @@ enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
     {
        if (command >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
            buffer >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
-           peer -> mtu - host -> packetSize < sizeof (ENetProtocolAcknowledge))
+           peer -> mtu - host -> packetSize < commandSize)
        {
           peer -> flags |= ENET_PEER_FLAG_CONTINUE_SENDING;
 
           break;
        }
 
-       acknowledgement = (ENetAcknowledgement *) currentAcknowledgement;
- 
-       currentAcknowledgement = enet_list_next (currentAcknowledgement);
-
        buffer -> data = command;
-       buffer -> dataLength = sizeof (ENetProtocolAcknowledge);
+       buffer -> dataLength = commandSize;
 
        host -> packetSize += buffer -> dataLength;
 
+       if (peer -> protocolFeatures & ENET_PROTOCOL_FEATURE_ACKNOWLEDGE_RANGE)
+       {
+          enet_protocol_build_acknowledge_range (host, peer, command);
+
+          currentAcknowledgement = enet_list_begin (& peer -> acknowledgements);
+
+          ++ command;
+          ++ buffer;
+          continue;
+       }
+
+       acknowledgement = (ENetAcknowledgement *) currentAcknowledgement;
+ 
+       currentAcknowledgement = enet_list_next (currentAcknowledgement);
+
        reliableSequenceNumber = ENET_HOST_TO_NET_16 (acknowledgement -> command.header.reliableSequenceNumber);
   
        command -> header.command = ENET_PROTOCOL_COMMAND_ACKNOWLEDGE;
@@ -1346,6 +2489,9 @@ enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
        ++ buffer;
     }
 
+    if (enet_list_empty (& peer -> acknowledgements))
+      peer -> flags &= ~ ENET_PEER_FLAG_ACKNOWLEDGE_NOW;
+
     host -> commandCount = command - host -> commands;
     host -> bufferCount = buffer - host -> buffers;
 }
@@ -1354,11 +2500,9 @@ static int
 enet_protocol_check_timeouts (ENetHost * host, ENetPeer * peer, ENetEvent * event)
 {
     ENetOutgoingCommand * outgoingCommand;
-    ENetListIterator currentCommand, insertPosition, insertSendReliablePosition;
+    ENetListIterator currentCommand;
 
     currentCommand = enet_list_begin (& peer -> sentReliableCommands);
-    insertPosition = enet_list_begin (& peer -> outgoingCommands);
-    insertSendReliablePosition = enet_list_begin (& peer -> outgoingSendReliableCommands);
 
     while (currentCommand != enet_list_end (& peer -> sentReliableCommands))
     {
@@ -1369,6 +2513,13 @@ enet_protocol_check_timeouts (ENetHost * host, ENetPeer * peer, ENetEvent * even
        if (ENET_TIME_DIFFERENCE (host -> serviceTime, outgoingCommand -> sentTime) < outgoingCommand -> roundTripTimeout)
          continue;
 
+       if (enet_protocol_is_mtu_probe (outgoingCommand))
+       {
+          enet_protocol_lose_mtu_probe (host, peer, outgoingCommand);
+
+          goto nextTimeout;
+       }
+
        if (peer -> earliestTimeout == 0 ||
            ENET_TIME_LESS (outgoingCommand -> sentTime, peer -> earliestTimeout))
          peer -> earliestTimeout = outgoingCommand -> sentTime;
@@ -1383,19 +2534,13 @@ enet_protocol_check_timeouts (ENetHost * host, ENetPeer * peer, ENetEvent * even
           return 1;
        }
 
-       ++ peer -> packetsLost;
+       enet_protocol_detect_mtu_black_hole (host, peer, outgoingCommand);
 
        outgoingCommand -> roundTripTimeout *= 2;
 
-       if (outgoingCommand -> packet != NULL)
-       {
-         peer -> reliableDataInTransit -= outgoingCommand -> fragmentLength;
-
-         enet_list_insert (insertSendReliablePosition, enet_list_remove (& outgoingCommand -> outgoingCommandList));
-       }
-       else
-         enet_list_insert (insertPosition, enet_list_remove (& outgoingCommand -> outgoingCommandList));
+       enet_protocol_retransmit_command (host, peer, outgoingCommand);
 
+    nextTimeout:
        if (currentCommand == enet_list_begin (& peer -> sentReliableCommands) &&
            ! enet_list_empty (& peer -> sentReliableCommands))
        {
@@ -1418,7 +2563,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
     ENetChannel *channel = NULL;
     enet_uint16 reliableWindow = 0;
     size_t commandSize;
-    int windowWrap = 0, canPing = 1;
+    int windowWrap = 0, canPing = 1, compressible = 1;
 
     currentCommand = enet_list_begin (& peer -> outgoingCommands);
     currentSendReliableCommand = enet_list_begin (& peer -> outgoingSendReliableCommands);
@@ -1430,7 +2575,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
           outgoingCommand = (ENetOutgoingCommand *) currentCommand;
 
           if (currentSendReliableCommand != enet_list_end (& peer -> outgoingSendReliableCommands) &&
-              ENET_TIME_LESS (((ENetOutgoingCommand *) currentSendReliableCommand) -> queueTime, outgoingCommand -> queueTime))
+              ((ENetOutgoingCommand *) currentSendReliableCommand) -> queueOrder < outgoingCommand -> queueOrder)
             goto useSendReliableCommand;
 
           currentCommand = enet_list_next (currentCommand);
@@ -1447,6 +2592,10 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
 
        if (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE)
        {
+          /* a packet past its retransmit limit or lifetime goes out as a skip instead */
+          if (enet_protocol_is_abandoned (host, peer, outgoingCommand))
+            enet_protocol_abandon_packet (host, peer, outgoingCommand);
+
           channel = outgoingCommand -> command.header.channelID < peer -> channelCount ? & peer -> channels [outgoingCommand -> command.header.channelID] : NULL;
           reliableWindow = outgoingCommand -> reliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
           if (channel != NULL)
@@ -1469,7 +2618,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
 
           if (outgoingCommand -> packet != NULL)
           {
-             enet_uint32 windowSize = (peer -> packetThrottle * peer -> windowSize) / ENET_PEER_PACKET_THROTTLE_SCALE;
+             enet_uint32 windowSize = enet_peer_congestion_window (peer);
 
              if (peer -> reliableDataInTransit + outgoingCommand -> fragmentLength > ENET_MAX (windowSize, peer -> mtu))
              {
@@ -1482,12 +2631,28 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
           canPing = 0;
        }
 
+       /* payload that must not be compressed goes out in separate datagrams from payload that may be */
+       if (outgoingCommand -> packet != NULL && host -> compressor.context != NULL)
+       {
+          compressible = ! enet_protocol_is_mtu_probe (outgoingCommand) &&
+                         (outgoingCommand -> command.header.channelID >= peer -> channelCount ||
+                           ! (peer -> channels [outgoingCommand -> command.header.channelID].flags & ENET_CHANNEL_FLAG_NO_COMPRESS));
+
+          if (host -> packetCompressible >= 0 && host -> packetCompressible != compressible)
+          {
+             peer -> flags |= ENET_PEER_FLAG_CONTINUE_SENDING;
+
+             break;
+          }
+       }
+
+       /* a command too large for the MTU, such as a probe or a fragment queued before the MTU shrank,
+          goes out in a datagram of its own */
        commandSize = commandSizes [outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK];
        if (command >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
            buffer + 1 >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
-           peer -> mtu - host -> packetSize < commandSize ||
-           (outgoingCommand -> packet != NULL && 
-             (enet_uint16) (peer -> mtu - host -> packetSize) < (enet_uint16) (commandSize + outgoingCommand -> fragmentLength)))
+           (command > host -> commands &&
+             host -> packetSize + commandSize + (outgoingCommand -> packet != NULL ? outgoingCommand -> fragmentLength : 0) > peer -> mtu))
        {
           peer -> flags |= ENET_PEER_FLAG_CONTINUE_SENDING;
 
@@ -1505,7 +2670,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
           ++ outgoingCommand -> sendAttempts;
  
           if (outgoingCommand -> roundTripTimeout == 0)
-            outgoingCommand -> roundTripTimeout = peer -> roundTripTime + 4 * peer -> roundTripTimeVariance;
+            outgoingCommand -> roundTripTimeout = peer -> roundTripTime + 4 * peer -> roundTripTimeVariance + peer -> remoteAcknowledgementDelay;
 
           if (enet_list_empty (& peer -> sentReliableCommands))
             peer -> nextTimeout = host -> serviceTime + outgoingCommand -> roundTripTimeout;
@@ -1514,6 +2679,7 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
                             enet_list_remove (& outgoingCommand -> outgoingCommandList));
 
           outgoingCommand -> sentTime = host -> serviceTime;
+          outgoingCommand -> sendOrder = ++ peer -> reliableSendOrder;
 
           host -> headerFlags |= ENET_PROTOCOL_HEADER_FLAG_SENT_TIME;
 
@@ -1521,17 +2687,39 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
        }
        else
        {
-          if (outgoingCommand -> packet != NULL && outgoingCommand -> fragmentOffset == 0)
+          if (outgoingCommand -> command.header.channelID < peer -> channelCount &&
+              peer -> channels [outgoingCommand -> command.header.channelID].supersedableCommand == outgoingCommand)
+            peer -> channels [outgoingCommand -> command.header.channelID].supersedableCommand = NULL;
+
+          /* a packet is expired or throttled as a whole at its first fragment, along with the parity fragments following it */
+          if (outgoingCommand -> packet != NULL && outgoingCommand -> fragmentOffset == 0 &&
+              (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_SEND_PARITY_FRAGMENT)
           {
-             peer -> packetThrottleCounter += ENET_PEER_PACKET_THROTTLE_COUNTER;
-             peer -> packetThrottleCounter %= ENET_PEER_PACKET_THROTTLE_SCALE;
+             ENetDropReason dropReason = ENET_DROP_REASON_COUNT;
+
+             if (outgoingCommand -> packet -> lifetime != 0 &&
+                 ENET_TIME_DIFFERENCE (host -> serviceTime, outgoingCommand -> enqueueTime) >= outgoingCommand -> packet -> lifetime)
+               dropReason = ENET_DROP_REASON_EXPIRED;
+             else
+             {
+                peer -> packetThrottleCounter += ENET_PEER_PACKET_THROTTLE_COUNTER;
+                peer -> packetThrottleCounter %= ENET_PEER_PACKET_THROTTLE_SCALE;
+
+                if (peer -> packetThrottleCounter > peer -> packetThrottle)
+                  dropReason = ENET_DROP_REASON_THROTTLED;
+             }
 
-             if (peer -> packetThrottleCounter > peer -> packetThrottle)
+             if (dropReason != ENET_DROP_REASON_COUNT)
              {
                 enet_uint16 reliableSequenceNumber = outgoingCommand -> reliableSequenceNumber,
                             unreliableSequenceNumber = outgoingCommand -> unreliableSequenceNumber;
                 for (;;)
                 {
+                   ++ host -> counters.drops [dropReason];
+
+                   ENET_TRACE (host, ENET_TRACE_EVENT_COMMAND_DROPPED, command_dropped, peer -> incomingPeerID,
+                               outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK, outgoingCommand -> reliableSequenceNumber, outgoingCommand -> unreliableSequenceNumber);
+
                    -- outgoingCommand -> packet -> referenceCount;
 
                    if (outgoingCommand -> packet -> referenceCount == 0)
@@ -1561,6 +2749,17 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
             enet_list_insert (enet_list_end (sentUnreliableCommands), outgoingCommand);
        }
 
+       if (! (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE) || outgoingCommand -> sendAttempts == 1)
+       {
+          enet_uint64 startTime = outgoingCommand -> queueOrder & (((enet_uint64) 1 << ENET_PEER_SCHEDULE_TIME_BITS) - 1);
+
+          if (startTime > peer -> scheduleTime)
+            peer -> scheduleTime = startTime;
+
+          enet_histogram_add (& peer -> histograms.queueTime, ENET_TIME_DIFFERENCE (host -> serviceTime, outgoingCommand -> enqueueTime));
+          enet_histogram_add (& host -> histograms.queueTime, ENET_TIME_DIFFERENCE (host -> serviceTime, outgoingCommand -> enqueueTime));
+       }
+
        buffer -> data = command;
        buffer -> dataLength = commandSize;
 
@@ -1570,6 +2769,9 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
 
        if (outgoingCommand -> packet != NULL)
        {
+          if (host -> compressor.context != NULL)
+            host -> packetCompressible = compressible;
+
           ++ buffer;
           
           buffer -> data = outgoingCommand -> packet -> data + outgoingCommand -> fragmentOffset;
@@ -1598,6 +2800,339 @@ enet_protocol_check_outgoing_commands (ENetHost * host, ENetPeer * peer, ENetLis
     return canPing;
 }
 
+static int
+enet_protocol_wants_compression_record (ENetHost * host, ENetPeer * peer)
+{
+    ENetCompressionHistory * history = peer -> compressionHistory;
+    size_t i;
+
+    if (host -> compressor.compressWithDictionary == NULL ||
+        host -> packetSize < ENET_PEER_COMPRESSION_HISTORY_MINIMUM ||
+        (history -> outgoingDictionary != NULL &&
+         ENET_TIME_DIFFERENCE (host -> serviceTime, history -> outgoingRecordTime) < ENET_PEER_COMPRESSION_HISTORY_INTERVAL))
+      return 0;
+
+    for (i = 0; i < ENET_PEER_COMPRESSION_HISTORY; ++ i)
+      if (history -> outgoingRecords [i].number != 0 && ! history -> outgoingRecords [i].acknowledged)
+        return 0;
+
+    return 1;
+}
+
+/* With compression history, compressed data is prefixed by the number the datagram is recorded
+   under, or 0 if it is not recorded, and the number of the datagram used as a dictionary, or 0
+   for none. Recorded datagrams that do not compress may instead be sent stored. */
+static size_t
+enet_protocol_compress_with_history (ENetHost * host, ENetPeer * peer, size_t originalSize)
+{
+    ENetCompressionHistory * history = peer -> compressionHistory;
+    ENetCompressionRecord * dictionary = history -> outgoingDictionary, * record = NULL;
+    const ENetBuffer * inBuffers = & host -> buffers [1];
+    size_t inBufferCount = host -> bufferCount - 1, compressedSize;
+    ENetBuffer recordBuffer;
+    int stored = 0;
+
+    /* the peer only knows history is in use once it has seen the verify connect command */
+    if (peer -> state == ENET_PEER_STATE_ACKNOWLEDGING_CONNECT || originalSize <= 3)
+      return 0;
+
+    if (host -> headerFlags & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME)
+    {
+        const ENetProtocol * command;
+
+        for (command = host -> commands; command < & host -> commands [host -> commandCount]; ++ command)
+          if (command -> header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE)
+            break;
+
+        if (command < & host -> commands [host -> commandCount])
+        {
+            for (record = history -> outgoingRecords; record < & history -> outgoingRecords [ENET_PEER_COMPRESSION_HISTORY]; ++ record)
+              if (record -> number == 0)
+                break;
+
+            if (record < & history -> outgoingRecords [ENET_PEER_COMPRESSION_HISTORY] &&
+                enet_protocol_reserve_compression_record (record, originalSize) == 0)
+            {
+                enet_uint8 * data = record -> data;
+                const ENetBuffer * buffer;
+
+                for (buffer = inBuffers; buffer < & inBuffers [inBufferCount]; ++ buffer)
+                {
+                    memcpy (data, buffer -> data, buffer -> dataLength);
+                    data += buffer -> dataLength;
+                }
+
+                record -> channelID = command -> header.channelID;
+                record -> reliableSequenceNumber = ENET_NET_TO_HOST_16 (command -> header.reliableSequenceNumber);
+
+                recordBuffer.data = record -> data;
+                recordBuffer.dataLength = originalSize;
+                inBuffers = & recordBuffer;
+                inBufferCount = 1;
+            }
+            else
+              record = NULL;
+        }
+    }
+
+    /* two bytes are reserved for the datagram and dictionary numbers, and the result must still be strictly smaller,
+       since a recorded datagram that went out uncompressed would never be recorded by the peer */
+    if (dictionary != NULL && host -> compressor.compressWithDictionary != NULL)
+      compressedSize = host -> compressor.compressWithDictionary (host -> compressor.context,
+                           dictionary -> data, dictionary -> dataLength,
+                           inBuffers, inBufferCount,
+                           originalSize,
+                           host -> packetData [1] + 2,
+                           originalSize - 3);
+    else
+    {
+        dictionary = NULL;
+        compressedSize = host -> compressor.compress (host -> compressor.context,
+                           inBuffers, inBufferCount,
+                           originalSize,
+                           host -> packetData [1] + 2,
+                           originalSize - 3);
+    }
+    if (compressedSize <= 0 || compressedSize > originalSize - 3)
+    {
+        /* a recorded datagram is sent stored if it still fits, as otherwise data that does not
+           compress against a stale dictionary or on its own could never build up a new history */
+        if (record == NULL || host -> packetSize + 2 > peer -> mtu)
+          return 0;
+
+        memcpy (host -> packetData [1] + 2, record -> data, originalSize);
+        compressedSize = originalSize;
+        stored = 1;
+    }
+
+    if (record != NULL)
+    {
+        size_t i;
+
+        do
+        {
+            if (++ history -> outgoingNumber >= ENET_PROTOCOL_COMPRESSION_HISTORY_STORED)
+              history -> outgoingNumber = 1;
+
+            for (i = 0; i < ENET_PEER_COMPRESSION_HISTORY; ++ i)
+              if (history -> outgoingRecords [i].number == history -> outgoingNumber)
+                break;
+        } while (i < ENET_PEER_COMPRESSION_HISTORY);
+
+        record -> number = history -> outgoingNumber;
+        record -> acknowledged = 0;
+        history -> outgoingRecordTime = host -> serviceTime;
+        record -> sentTime = host -> serviceTime & 0xFFFF;
+        record -> dataLength = originalSize;
+    }
+
+    host -> packetData [1] [0] = record != NULL ? record -> number : 0;
+    host -> packetData [1] [1] = stored ? ENET_PROTOCOL_COMPRESSION_HISTORY_STORED : (dictionary != NULL ? dictionary -> number : 0);
+
+    return compressedSize + 2;
+}
+
+/* Picks the channel whose payload makes up most of the datagram, so that its compression yield
+   may be tracked separately from channels carrying data that compresses differently. */
+static ENetChannel *
+enet_protocol_dominant_channel (ENetHost * host, ENetPeer * peer)
+{
+    ENetChannel * dominantChannel = NULL;
+    size_t dominantLength = 0;
+    const ENetProtocol * command;
+
+    for (command = host -> commands; command < & host -> commands [host -> commandCount]; ++ command)
+    {
+        size_t dataLength;
+
+        if (command -> header.channelID >= peer -> channelCount)
+          continue;
+
+        switch (command -> header.command & ENET_PROTOCOL_COMMAND_MASK)
+        {
+        case ENET_PROTOCOL_COMMAND_SEND_RELIABLE:
+            dataLength = ENET_NET_TO_HOST_16 (command -> sendReliable.dataLength);
+            break;
+
+        case ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE:
+            dataLength = ENET_NET_TO_HOST_16 (command -> sendUnreliable.dataLength);
+            break;
+
+        case ENET_PROTOCOL_COMMAND_SEND_UNSEQUENCED:
+            dataLength = ENET_NET_TO_HOST_16 (command -> sendUnsequenced.dataLength);
+            break;
+
+        case ENET_PROTOCOL_COMMAND_SEND_FRAGMENT:
+        case ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT:
+            dataLength = ENET_NET_TO_HOST_16 (command -> sendFragment.dataLength);
+            break;
+
+        default:
+            continue;
+        }
+
+        if (dataLength > dominantLength)
+        {
+            dominantChannel = & peer -> channels [command -> header.channelID];
+            dominantLength = dataLength;
+        }
+    }
+
+    return dominantChannel;
+}
+
+/* Once compression has stopped paying off for a channel, or for the peer when no channel dominates,
+   the compressor is skipped except for an occasional probe to notice when the data changes. */
+static int
+enet_protocol_bypass_compression (ENetPeer * peer, ENetChannel * channel)
+{
+    enet_uint32 compressionYield = channel != NULL ? channel -> compressionYield : peer -> compressionYield;
+
+    if (compressionYield >= ENET_PEER_COMPRESSION_YIELD_THRESHOLD)
+      return 0;
+
+    if (++ peer -> compressionProbeCounter >= ENET_PEER_COMPRESSION_PROBE_INTERVAL)
+    {
+        peer -> compressionProbeCounter = 0;
+        return 0;
+    }
+
+    ++ peer -> compressionStatistics.bypassedDatagrams;
+    ++ peer -> host -> compressionStatistics.bypassedDatagrams;
+
+    return 1;
+}
+
+static void
+enet_protocol_update_compression_yield (ENetPeer * peer, ENetChannel * channel, size_t originalSize, size_t sentSize, enet_uint32 compressorTime)
+{
+    ENetHost * host = peer -> host;
+    size_t savings = sentSize < originalSize ? originalSize - sentSize : 0;
+    enet_uint32 compressionYield = originalSize > 0 ? (enet_uint32) (savings * ENET_PEER_COMPRESSION_YIELD_SCALE / originalSize) : 0;
+
+    peer -> compressionYield = (peer -> compressionYield * 7 + compressionYield) / 8;
+    if (channel != NULL)
+      channel -> compressionYield = (channel -> compressionYield * 7 + compressionYield) / 8;
+
+    ++ peer -> compressionStatistics.compressedDatagrams;
+    peer -> compressionStatistics.compressorInput += originalSize;
+    peer -> compressionStatistics.compressorSavings += savings;
+    peer -> compressionStatistics.compressorTime += compressorTime;
+
+    ++ host -> compressionStatistics.compressedDatagrams;
+    host -> compressionStatistics.compressorInput += originalSize;
+    host -> compressionStatistics.compressorSavings += savings;
+    host -> compressionStatistics.compressorTime += compressorTime;
+}
+
+static void
+enet_protocol_defer_send (ENetHost * host, enet_uint32 deadline)
+{
+    if (! host -> sendDeferred || ENET_TIME_LESS (deadline, host -> sendDeadline))
+      host -> sendDeadline = deadline;
+    host -> sendDeferred = 1;
+}
+
+/* Returns 1 if the queued acknowledgements of a peer may wait for data to accompany them, noting
+   when the host should send them regardless. Once they go, they all go, over several datagrams
+   if need be. */
+static int
+enet_protocol_delay_acknowledgements (ENetHost * host, ENetPeer * peer)
+{
+    ENetAcknowledgement * acknowledgement = (ENetAcknowledgement *) enet_list_front (& peer -> acknowledgements);
+    ENetListIterator currentAcknowledgement;
+    enet_uint32 count = 0;
+
+    if (peer -> acknowledgementDelay == 0 ||
+        (peer -> flags & ENET_PEER_FLAG_ACKNOWLEDGE_NOW) ||
+        peer -> state != ENET_PEER_STATE_CONNECTED ||
+        ! enet_list_empty (& peer -> outgoingCommands) ||
+        ! enet_list_empty (& peer -> outgoingSendReliableCommands) ||
+        ENET_TIME_DIFFERENCE (host -> serviceTime, acknowledgement -> receivedTime) >= peer -> acknowledgementDelay)
+      goto sendAcknowledgements;
+
+    if (peer -> acknowledgementFrequency > 0)
+    {
+        for (currentAcknowledgement = enet_list_begin (& peer -> acknowledgements);
+             currentAcknowledgement != enet_list_end (& peer -> acknowledgements);
+             currentAcknowledgement = enet_list_next (currentAcknowledgement))
+          if (++ count >= peer -> acknowledgementFrequency)
+            goto sendAcknowledgements;
+    }
+
+    enet_protocol_defer_send (host, acknowledgement -> receivedTime + peer -> acknowledgementDelay);
+    return 1;
+
+sendAcknowledgements:
+    peer -> flags |= ENET_PEER_FLAG_ACKNOWLEDGE_NOW;
+    return 0;
+}
+
+/* Refills the token bucket of a peer paced by its congestion control at the rate it reports,
+   allowing a burst of at most a couple of milliseconds worth or a couple of datagrams. Returns
+   1 if the peer has data waiting but no budget left, noting when the host should next try. */
+static int
+enet_protocol_hold_paced_peer (ENetHost * host, ENetPeer * peer)
+{
+    enet_uint32 rate, burst, wait;
+    enet_uint64 budget;
+
+    if (peer -> congestionState == NULL || host -> congestionControl.pacingRate == NULL ||
+        (enet_list_empty (& peer -> outgoingCommands) && enet_list_empty (& peer -> outgoingSendReliableCommands)))
+      return 0;
+
+    rate = host -> congestionControl.pacingRate (peer -> congestionState, peer);
+    if (rate == 0)
+      return 0;
+
+    burst = ENET_MAX (rate / 1000 * ENET_PEER_PACING_BURST_TIME, ENET_PEER_PACING_BURST_DATAGRAMS * peer -> mtu);
+    budget = peer -> pacingBudget + (enet_uint64) rate * ENET_TIME_DIFFERENCE (host -> serviceTime, peer -> pacingTime) / 1000;
+    peer -> pacingBudget = budget > burst ? burst : (enet_uint32) budget;
+    peer -> pacingTime = host -> serviceTime;
+
+    if (peer -> pacingBudget > 0)
+      return 0;
+
+    wait = (enet_uint32) (((enet_uint64) peer -> mtu * 1000 + rate - 1) / rate);
+    enet_protocol_defer_send (host, host -> serviceTime + ENET_MAX (wait, 1));
+
+    return 1;
+}
+
+/* Clears the don't-fragment option only while datagrams need it, rather than around each one. */
+static void
+enet_protocol_allow_fragmentation (ENetHost * host, int allow)
+{
+    if (host -> fragmentationAllowed == allow)
+      return;
+
+    enet_socket_set_option (host -> socket, ENET_SOCKOPT_DONTFRAGMENT, allow ? -1 : 1);
+
+    host -> fragmentationAllowed = allow;
+}
+
+/* Commands sized for an MTU that since shrank can only get through fragmented, whereas probes
+   must not be. Either is only ever preceded by acknowledgements, so a datagram over the MTU holds
+   a probe if it holds any ping. Datagrams within the MTU leave the option as it is. */
+static void
+enet_protocol_update_fragmentation (ENetHost * host, ENetPeer * peer)
+{
+    ENetProtocol * command;
+
+    if (host -> maximumMtu == 0 || host -> packetSize <= peer -> mtu)
+      return;
+
+    for (command = host -> commands; command < & host -> commands [host -> commandCount]; ++ command)
+      if ((command -> header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_PING)
+      {
+          enet_protocol_allow_fragmentation (host, 0);
+
+          return;
+      }
+
+    enet_protocol_allow_fragmentation (host, 1);
+}
+
 static int
 enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int checkForTimeouts)
 {
@@ -1605,10 +3140,16 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
     ENetProtocolHeader * header = (ENetProtocolHeader *) headerData;
     int sentLength = 0;
     size_t shouldCompress = 0;
+    ENetChannel * compressionChannel;
+    int bypassCompression;
     ENetList sentUnreliableCommands;
+    ENetProtocol * command;
+    int held;
 
     enet_list_clear (& sentUnreliableCommands);
 
+    host -> sendDeferred = 0;
+
     for (int sendPass = 0, continueSending = 0; sendPass <= continueSending; ++ sendPass)
     for (ENetPeer * currentPeer = host -> peers;
          currentPeer < & host -> peers [host -> peerCount];
@@ -1622,11 +3163,13 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
         currentPeer -> flags &= ~ ENET_PEER_FLAG_CONTINUE_SENDING;
 
         host -> headerFlags = 0;
+        host -> packetCompressible = -1;
         host -> commandCount = 0;
         host -> bufferCount = 1;
         host -> packetSize = sizeof (ENetProtocolHeader);
 
-        if (! enet_list_empty (& currentPeer -> acknowledgements))
+        if (! enet_list_empty (& currentPeer -> acknowledgements) &&
+            ! enet_protocol_delay_acknowledgements (host, currentPeer))
           enet_protocol_send_acknowledgements (host, currentPeer);
 
         if (checkForTimeouts != 0 &&
@@ -1635,17 +3178,32 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
             enet_protocol_check_timeouts (host, currentPeer, event) == 1)
         {
             if (event != NULL && event -> type != ENET_EVENT_TYPE_NONE)
-              return 1;
+            {
+                enet_protocol_allow_fragmentation (host, 0);
+
+                return 1;
+            }
             else
               goto nextPeer;
         }
 
-        if (((enet_list_empty (& currentPeer -> outgoingCommands) &&
+        /* acknowledgements are never held back, so a peer out of pacing budget may still send a datagram of them */
+        held = enet_protocol_hold_paced_peer (host, currentPeer);
+
+        if (! held &&
+            currentPeer -> state == ENET_PEER_STATE_CONNECTED &&
+            currentPeer -> mtuProbeSize == 0 &&
+            currentPeer -> mtuProbeLow + ENET_PEER_MTU_PROBE_GRANULARITY <= currentPeer -> mtuProbeHigh &&
+            ENET_TIME_GREATER_EQUAL (host -> serviceTime, currentPeer -> mtuProbeTime))
+          enet_protocol_probe_mtu (host, currentPeer);
+
+        if (! held &&
+            ((enet_list_empty (& currentPeer -> outgoingCommands) &&
               enet_list_empty (& currentPeer -> outgoingSendReliableCommands)) ||
              enet_protocol_check_outgoing_commands (host, currentPeer, & sentUnreliableCommands)) &&
             enet_list_empty (& currentPeer -> sentReliableCommands) &&
             ENET_TIME_DIFFERENCE (host -> serviceTime, currentPeer -> lastReceiveTime) >= currentPeer -> pingInterval &&
-            currentPeer -> mtu - host -> packetSize >= sizeof (ENetProtocolPing))
+            host -> packetSize + sizeof (ENetProtocolPing) <= currentPeer -> mtu)
         { 
             enet_peer_ping (currentPeer);
             enet_protocol_check_outgoing_commands (host, currentPeer, & sentUnreliableCommands);
@@ -1654,6 +3212,27 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
         if (host -> commandCount == 0)
           goto nextPeer;
 
+        compressionChannel = NULL;
+        bypassCompression = 1;
+        if (host -> compressor.context != NULL && host -> compressor.compress != NULL && host -> packetCompressible != 0)
+        {
+            compressionChannel = enet_protocol_dominant_channel (host, currentPeer);
+            bypassCompression = enet_protocol_bypass_compression (currentPeer, compressionChannel);
+        }
+
+        /* only datagrams carrying reliable commands become history, so pure unreliable traffic
+           occasionally gets a ping attached to keep a recent dictionary available */
+        if (! held &&
+            ! bypassCompression &&
+            currentPeer -> compressionHistory != NULL &&
+            ! (host -> headerFlags & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME) &&
+            host -> packetSize + sizeof (ENetProtocolPing) <= currentPeer -> mtu &&
+            enet_protocol_wants_compression_record (host, currentPeer))
+        {
+            enet_peer_ping (currentPeer);
+            enet_protocol_check_outgoing_commands (host, currentPeer, & sentUnreliableCommands);
+        }
+
         if (currentPeer -> packetLossEpoch == 0)
           currentPeer -> packetLossEpoch = host -> serviceTime;
         else
@@ -1685,15 +3264,18 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
           host -> buffers -> dataLength = ENET_OFFSETOF(ENetProtocolHeader, sentTime);
 
         shouldCompress = 0;
-        if (host -> compressor.context != NULL && host -> compressor.compress != NULL)
+        if (! bypassCompression)
         {
+            enet_uint32 compressorStart = enet_time_get_microseconds ();
             size_t originalSize = host -> packetSize - sizeof(ENetProtocolHeader),
-                   compressedSize = host -> compressor.compress (host -> compressor.context,
+                   compressedSize = currentPeer -> compressionHistory != NULL ?
+                                      enet_protocol_compress_with_history (host, currentPeer, originalSize) :
+                                      host -> compressor.compress (host -> compressor.context,
                                         & host -> buffers [1], host -> bufferCount - 1,
                                         originalSize,
                                         host -> packetData [1],
                                         originalSize);
-            if (compressedSize > 0 && compressedSize < originalSize)
+            if (compressedSize > 0 && (compressedSize < originalSize || currentPeer -> compressionHistory != NULL))
             {
                 host -> headerFlags |= ENET_PROTOCOL_HEADER_FLAG_COMPRESSED;
                 shouldCompress = compressedSize;
@@ -1701,6 +3283,10 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
                 printf ("peer %u: compressed %u -> %u (%u%%)\n", currentPeer -> incomingPeerID, originalSize, compressedSize, (compressedSize * 100) / originalSize);
 #endif
             }
+
+            enet_protocol_update_compression_yield (currentPeer, compressionChannel, originalSize,
+                                                    shouldCompress > 0 ? shouldCompress : originalSize,
+                                                    enet_time_get_microseconds () - compressorStart);
         }
 
         if (currentPeer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_PEER_ID)
@@ -1726,20 +3312,40 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
 
         currentPeer -> lastSendTime = host -> serviceTime;
 
+        enet_protocol_update_fragmentation (host, currentPeer);
+
         sentLength = enet_socket_send (host -> socket, & currentPeer -> address, host -> buffers, host -> bufferCount);
 
+        ENET_TRACE (host, ENET_TRACE_EVENT_DATAGRAM_SENT, datagram_sent, currentPeer -> incomingPeerID, sentLength, host -> commandCount, host -> headerFlags);
+
         enet_protocol_remove_sent_unreliable_commands (currentPeer, & sentUnreliableCommands);
 
         if (sentLength < 0)
-          return -1;
+        {
+            enet_protocol_allow_fragmentation (host, 0);
+
+            return -1;
+        }
 
         host -> totalSentData += sentLength;
         host -> totalSentPackets ++;
+        host -> counters.sentData += sentLength;
+        ++ host -> counters.sentDatagrams;
+
+        currentPeer -> pacingBudget = currentPeer -> pacingBudget > (enet_uint32) sentLength ? currentPeer -> pacingBudget - sentLength : 0;
+
+        if (currentPeer -> congestionState != NULL && host -> congestionControl.send != NULL)
+          host -> congestionControl.send (currentPeer -> congestionState, currentPeer, sentLength);
+
+        for (command = host -> commands; command < & host -> commands [host -> commandCount]; ++ command)
+          ++ host -> counters.sentCommands [command -> header.command & ENET_PROTOCOL_COMMAND_MASK];
 
     nextPeer:
         if (currentPeer -> flags & ENET_PEER_FLAG_CONTINUE_SENDING)
           continueSending = sendPass + 1;
     }
+
+    enet_protocol_allow_fragmentation (host, 0);
    
     return 0;
 }
@@ -1795,7 +3401,8 @@ enet_host_check_events (ENetHost * host, ENetEvent * event)
 int
 enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
 {
-    enet_uint32 waitCondition;
+    enet_uint32 waitCondition, waitTime, releaseTime;
+    int impaired;
 
     if (event != NULL)
     {
@@ -1907,9 +3514,22 @@ enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
             return 0;
 
           waitCondition = ENET_SOCKET_WAIT_RECEIVE | ENET_SOCKET_WAIT_INTERRUPT;
+          waitTime = ENET_TIME_DIFFERENCE (timeout, host -> serviceTime);
+
+          /* wake up for datagrams held back by an impairment as if they had just arrived */
+          impaired = enet_host_impairment_pending (host, & releaseTime);
+          if (impaired)
+            waitTime = ENET_TIME_LESS (releaseTime, host -> serviceTime) ? 0 : ENET_MIN (waitTime, ENET_TIME_DIFFERENCE (releaseTime, host -> serviceTime));
 
-          if (enet_socket_wait (host -> socket, & waitCondition, ENET_TIME_DIFFERENCE (timeout, host -> serviceTime)) != 0)
+          /* likewise wake up once pacing or delayed acknowledgements let held back datagrams go */
+          if (host -> sendDeferred)
+            waitTime = ENET_TIME_LESS (host -> sendDeadline, host -> serviceTime) ? 0 : ENET_MIN (waitTime, ENET_TIME_DIFFERENCE (host -> sendDeadline, host -> serviceTime));
+
+          if (enet_socket_wait (host -> socket, & waitCondition, waitTime) != 0)
             return -1;
+
+          if ((impaired || host -> sendDeferred) && waitCondition == ENET_SOCKET_WAIT_NONE)
+            waitCondition = ENET_SOCKET_WAIT_RECEIVE;
        }
        while (waitCondition & ENET_SOCKET_WAIT_INTERRUPT);
 
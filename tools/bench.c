@@ -0,0 +1,380 @@
+/**
+ @file  bench.c
+ @brief Loopback throughput and latency benchmark
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <enet/enet.h>
+
+/* A server host and a number of client hosts run in one process over 127.0.0.1, with the clients
+   streaming messages to the server. Each message carries the sending client, a sequence number and
+   the time it was sent, so one-way latency is measured against the same clock on both ends. Each
+   client keeps at most a window of messages in flight beyond the latest one the server received.
+   Latency, jitter and loss are emulated by impairing every host, so each direction of a connection
+   sees the configured conditions and the round trip time is twice the latency. */
+
+typedef struct _BenchMode
+{
+    const char * name;
+    enet_uint32 flags;
+    size_t size;
+} BenchMode;
+
+typedef struct _BenchClient
+{
+    ENetHost * host;
+    ENetPeer * peer;
+    enet_uint32 sent;
+    enet_uint32 received;
+} BenchClient;
+
+enum
+{
+    BENCH_HEADER_SIZE = 12,
+    BENCH_FRAGMENTED_SIZE = 16384,
+    BENCH_TIMEOUT = 10000000
+};
+
+static size_t allocations;
+static ENetImpairment impairment;
+static int impaired;
+static int bbr;
+
+static void * ENET_CALLBACK
+bench_malloc (size_t size)
+{
+    ++ allocations;
+    return malloc (size);
+}
+
+static void ENET_CALLBACK
+bench_free (void * memory)
+{
+    free (memory);
+}
+
+static void
+usage (const char * program)
+{
+    fprintf (stderr, "usage: %s [-c clients] [-n messages] [-s size] [-w window] [-l latency] [-j jitter] [-p loss%%] [-b] [reliable|unreliable|unsequenced|fragmented]...\n", program);
+}
+
+static void
+write_uint32 (enet_uint8 * data, enet_uint32 value)
+{
+    data [0] = (enet_uint8) (value >> 24);
+    data [1] = (enet_uint8) (value >> 16);
+    data [2] = (enet_uint8) (value >> 8);
+    data [3] = (enet_uint8) value;
+}
+
+static enet_uint32
+read_uint32 (const enet_uint8 * data)
+{
+    return ((enet_uint32) data [0] << 24) | ((enet_uint32) data [1] << 16) | ((enet_uint32) data [2] << 8) | data [3];
+}
+
+static int
+compare_latency (const void * a, const void * b)
+{
+    enet_uint32 x = * (const enet_uint32 *) a, y = * (const enet_uint32 *) b;
+
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static enet_uint32
+percentile (const enet_uint32 * latencies, size_t count, size_t permille)
+{
+    size_t index;
+
+    if (count == 0)
+      return 0;
+
+    index = (count * permille) / 1000;
+    return latencies [index < count ? index : count - 1];
+}
+
+static int
+impair (ENetHost * host, enet_uint32 seed)
+{
+    ENetImpairment hostImpairment = impairment;
+
+    if (bbr)
+      enet_host_congestion_control_with_bbr (host);
+
+    if (! impaired)
+      return 0;
+
+    hostImpairment.seed = seed;
+    return enet_host_impair (host, & hostImpairment);
+}
+
+static int
+run (const BenchMode * mode, size_t clientCount, enet_uint32 messages, enet_uint32 window)
+{
+    ENetAddress address;
+    ENetHost * server;
+    ENetEvent event;
+    BenchClient * clients;
+    enet_uint32 * latencies, latencyCount = 0, total = messages * (enet_uint32) clientCount,
+                connected = 0, start, elapsed, lastProgress;
+    enet_uint8 * message;
+    size_t i, bytes = 0, startAllocations;
+    clock_t startClock, cpu;
+    int result = -1;
+
+    enet_address_set_host (& address, "127.0.0.1");
+    address.port = 0;
+
+    server = enet_host_create (& address, clientCount, 1, 0, 0);
+    clients = (BenchClient *) calloc (clientCount, sizeof (BenchClient));
+    latencies = (enet_uint32 *) malloc (total * sizeof (enet_uint32));
+    message = (enet_uint8 *) calloc (mode -> size, 1);
+    if (server == NULL || clients == NULL || latencies == NULL || message == NULL ||
+        enet_socket_get_address (server -> socket, & address) < 0 ||
+        impair (server, 0) < 0)
+      goto cleanup;
+
+    for (i = 0; i < clientCount; ++ i)
+    {
+        clients [i].host = enet_host_create (NULL, 1, 1, 0, 0);
+        if (clients [i].host == NULL || impair (clients [i].host, (enet_uint32) i + 1) < 0)
+          goto cleanup;
+
+        clients [i].peer = enet_host_connect (clients [i].host, & address, 1, 0);
+        if (clients [i].peer == NULL)
+          goto cleanup;
+    }
+
+    lastProgress = enet_time_get_microseconds ();
+    while (connected < clientCount)
+    {
+        for (i = 0; i < clientCount; ++ i)
+          while (enet_host_service (clients [i].host, & event, 0) > 0)
+            if (event.type == ENET_EVENT_TYPE_CONNECT)
+              ++ connected;
+
+        while (enet_host_service (server, & event, 0) > 0);
+
+        if (enet_time_get_microseconds () - lastProgress > BENCH_TIMEOUT)
+        {
+            fprintf (stderr, "%s: clients failed to connect\n", mode -> name);
+            goto cleanup;
+        }
+    }
+
+    startAllocations = allocations;
+    startClock = clock ();
+    start = lastProgress = enet_time_get_microseconds ();
+
+    /* unreliable messages may be dropped, so their run ends once everything is sent and the server goes quiet,
+       while reliable runs wait for every message, however long its retransmissions take */
+    while (latencyCount < total)
+    {
+        int sending = 0;
+        enet_uint32 wait = 1;
+
+        for (i = 0; i < clientCount; ++ i)
+        {
+            BenchClient * client = & clients [i];
+
+            while (client -> sent < messages && client -> sent - client -> received < window)
+            {
+                ENetPacket * packet;
+
+                write_uint32 (message, (enet_uint32) i);
+                write_uint32 (message + 4, client -> sent);
+                write_uint32 (message + 8, enet_time_get_microseconds ());
+
+                packet = enet_packet_create (message, mode -> size, mode -> flags);
+                if (packet == NULL || enet_peer_send (client -> peer, 0, packet) < 0)
+                {
+                    fprintf (stderr, "%s: send failed\n", mode -> name);
+                    goto cleanup;
+                }
+
+                ++ client -> sent;
+                wait = 0;
+            }
+
+            if (client -> sent < messages)
+              sending = 1;
+
+            enet_host_service (client -> host, & event, 0);
+        }
+
+        /* rather than spin while every window is full, wait briefly for the server to receive something */
+        for (; enet_host_service (server, & event, wait) > 0; wait = 0)
+        {
+            if (event.type != ENET_EVENT_TYPE_RECEIVE)
+              continue;
+
+            if (event.packet -> dataLength >= BENCH_HEADER_SIZE)
+            {
+                enet_uint32 clientIndex = read_uint32 (event.packet -> data),
+                            sequence = read_uint32 (event.packet -> data + 4),
+                            sentTime = read_uint32 (event.packet -> data + 8);
+
+                latencies [latencyCount ++] = enet_time_get_microseconds () - sentTime;
+                bytes += event.packet -> dataLength;
+
+                if (clientIndex < clientCount && sequence + 1 > clients [clientIndex].received)
+                  clients [clientIndex].received = sequence + 1;
+            }
+
+            enet_packet_destroy (event.packet);
+            lastProgress = enet_time_get_microseconds ();
+        }
+
+        if (! (mode -> flags & ENET_PACKET_FLAG_RELIABLE) && ! sending &&
+            enet_time_get_microseconds () - lastProgress > 100000 + 2000 * (impairment.latency + impairment.jitter))
+          break;
+        if (enet_time_get_microseconds () - lastProgress > BENCH_TIMEOUT)
+        {
+            fprintf (stderr, "%s: stalled\n", mode -> name);
+            break;
+        }
+    }
+
+    elapsed = lastProgress - start;
+    cpu = clock () - startClock;
+    if (elapsed == 0)
+      elapsed = 1;
+
+    qsort (latencies, latencyCount, sizeof (enet_uint32), compare_latency);
+
+    printf ("%-12s %8u/%-8u %10.0f msg/s %12.0f B/s   latency p50 %6u p99 %6u p999 %6u us   %6.2f us cpu/msg %6.2f allocs/msg\n",
+            mode -> name,
+            latencyCount, total,
+            latencyCount * 1000000.0 / elapsed,
+            bytes * 1000000.0 / elapsed,
+            percentile (latencies, latencyCount, 500),
+            percentile (latencies, latencyCount, 990),
+            percentile (latencies, latencyCount, 999),
+            latencyCount > 0 ? (double) cpu * 1000000.0 / CLOCKS_PER_SEC / latencyCount : 0.0,
+            latencyCount > 0 ? (double) (allocations - startAllocations) / latencyCount : 0.0);
+
+    result = 0;
+
+cleanup:
+    if (clients != NULL)
+    {
+        for (i = 0; i < clientCount; ++ i)
+          if (clients [i].host != NULL)
+            enet_host_destroy (clients [i].host);
+        free (clients);
+    }
+    if (server != NULL)
+      enet_host_destroy (server);
+    free (latencies);
+    free (message);
+    return result;
+}
+
+int
+main (int argc, char ** argv)
+{
+    BenchMode modes [] =
+    {
+        { "reliable", ENET_PACKET_FLAG_RELIABLE, 64 },
+        { "unreliable", 0, 64 },
+        { "unsequenced", ENET_PACKET_FLAG_UNSEQUENCED, 64 },
+        { "fragmented", ENET_PACKET_FLAG_RELIABLE, BENCH_FRAGMENTED_SIZE }
+    };
+    const size_t modeCount = sizeof (modes) / sizeof (modes [0]);
+    int selected [sizeof (modes) / sizeof (modes [0])] = { 0 }, anySelected = 0, argi, result = 0;
+    size_t clientCount = 4, size = 0, i;
+    enet_uint32 messages = 20000, window = 64;
+    ENetCallbacks callbacks = { bench_malloc, bench_free, NULL };
+
+    for (argi = 1; argi < argc; ++ argi)
+    {
+        if (strcmp (argv [argi], "-b") == 0)
+        {
+            bbr = 1;
+            continue;
+        }
+
+        if (argv [argi][0] == '-' && argi + 1 < argc)
+        {
+            double value = atof (argv [argi + 1]);
+
+            if (value < 0 || (value == 0 && strchr ("cnsw", argv [argi][1]) != NULL))
+            {
+                usage (argv [0]);
+                return 1;
+            }
+
+            switch (argv [argi][1])
+            {
+            case 'c': clientCount = (size_t) value; break;
+            case 'n': messages = (enet_uint32) value; break;
+            case 's': size = (size_t) value; break;
+            case 'w': window = (enet_uint32) value; break;
+            case 'l': impairment.latency = (enet_uint32) value; impaired = 1; break;
+            case 'j': impairment.jitter = (enet_uint32) value; impaired = 1; break;
+            case 'p':
+                impairment.loss = impairment.burstLoss = (enet_uint32) (value * ENET_IMPAIRMENT_PROBABILITY_SCALE / 100);
+                impaired = 1;
+                break;
+            default:
+                usage (argv [0]);
+                return 1;
+            }
+
+            ++ argi;
+            continue;
+        }
+
+        for (i = 0; i < modeCount; ++ i)
+          if (strcmp (argv [argi], modes [i].name) == 0)
+            break;
+
+        if (i >= modeCount)
+        {
+            usage (argv [0]);
+            return 1;
+        }
+
+        selected [i] = 1;
+        anySelected = 1;
+    }
+
+    if (clientCount > ENET_PROTOCOL_MAXIMUM_PEER_ID)
+    {
+        usage (argv [0]);
+        return 1;
+    }
+
+    if (enet_initialize_with_callbacks (ENET_VERSION, & callbacks) != 0)
+    {
+        fprintf (stderr, "%s: cannot initialize ENet\n", argv [0]);
+        return 1;
+    }
+
+    printf ("%u clients, %u messages per client, window %u", (unsigned) clientCount, messages, window);
+    if (impaired)
+      printf (", latency %u ms, jitter %u ms, loss %.2f%%", impairment.latency, impairment.jitter, impairment.loss * 100.0 / ENET_IMPAIRMENT_PROBABILITY_SCALE);
+    if (bbr)
+      printf (", delay-based congestion control");
+    printf ("\n");
+
+    for (i = 0; i < modeCount; ++ i)
+    {
+        if (anySelected && ! selected [i])
+          continue;
+
+        if (size > 0)
+          modes [i].size = size;
+        if (modes [i].size < BENCH_HEADER_SIZE)
+          modes [i].size = BENCH_HEADER_SIZE;
+
+        if (run (& modes [i], clientCount, messages, window) < 0)
+          result = 1;
+    }
+
+    enet_deinitialize ();
+    return result;
+}
@@ -0,0 +1,181 @@
+/**
+ @file  train_range_coder.c
+ @brief Builds a trained range coder model from a corpus of captured datagrams
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <enet/enet.h>
+
+/* Corpus files hold one sample after another, each prefixed by its length as a 16 bit big endian
+   integer. A sample is the contents of a datagram following the ENet header, exactly as it would
+   be passed to the compressor, so a corpus is most easily captured by wrapping the compress
+   callback of an ENetCompressor. With -r, every file is instead taken as a single raw sample. */
+
+static void
+usage (const char * program)
+{
+    fprintf (stderr, "usage: %s [-r] -o model corpus...\n", program);
+}
+
+static int
+read_file (const char * name, enet_uint8 ** data, size_t * dataLength)
+{
+    FILE * file = fopen (name, "rb");
+    long length;
+
+    if (file == NULL)
+      return -1;
+
+    if (fseek (file, 0, SEEK_END) != 0 ||
+        (length = ftell (file)) < 0 ||
+        fseek (file, 0, SEEK_SET) != 0)
+    {
+        fclose (file);
+        return -1;
+    }
+
+    * data = (enet_uint8 *) malloc (length > 0 ? (size_t) length : 1);
+    if (* data == NULL ||
+        fread (* data, 1, (size_t) length, file) != (size_t) length)
+    {
+        free (* data);
+        fclose (file);
+        return -1;
+    }
+
+    * dataLength = (size_t) length;
+    fclose (file);
+    return 0;
+}
+
+static int
+add_sample (ENetBuffer ** samples, size_t * sampleCount, size_t * sampleCapacity, void * data, size_t dataLength)
+{
+    if (* sampleCount >= * sampleCapacity)
+    {
+        size_t capacity = * sampleCapacity ? 2 * * sampleCapacity : 256;
+        ENetBuffer * resized = (ENetBuffer *) realloc (* samples, capacity * sizeof (ENetBuffer));
+        if (resized == NULL)
+          return -1;
+
+        * samples = resized;
+        * sampleCapacity = capacity;
+    }
+
+    (* samples) [* sampleCount].data = data;
+    (* samples) [* sampleCount].dataLength = dataLength;
+    ++ * sampleCount;
+    return 0;
+}
+
+int
+main (int argc, char ** argv)
+{
+    const char * output = NULL;
+    int raw = 0, argi, trained, result = 1;
+    ENetBuffer * samples = NULL;
+    size_t sampleCount = 0, sampleCapacity = 0, fileCount = 0, modelSize;
+    enet_uint8 ** files = NULL, * model = NULL;
+    void * rangeCoder = NULL;
+    FILE * file;
+
+    for (argi = 1; argi < argc && argv [argi][0] == '-'; ++ argi)
+    {
+        if (strcmp (argv [argi], "-r") == 0)
+          raw = 1;
+        else
+        if (strcmp (argv [argi], "-o") == 0 && argi + 1 < argc)
+          output = argv [++ argi];
+        else
+        {
+            usage (argv [0]);
+            return 1;
+        }
+    }
+
+    if (output == NULL || argi >= argc)
+    {
+        usage (argv [0]);
+        return 1;
+    }
+
+    files = (enet_uint8 **) calloc (argc - argi, sizeof (enet_uint8 *));
+    if (files == NULL)
+      goto cleanup;
+
+    for (; argi < argc; ++ argi)
+    {
+        enet_uint8 * data;
+        size_t dataLength, offset;
+
+        if (read_file (argv [argi], & data, & dataLength) < 0)
+        {
+            fprintf (stderr, "%s: cannot read %s\n", argv [0], argv [argi]);
+            goto cleanup;
+        }
+        files [fileCount ++] = data;
+
+        if (raw)
+        {
+            if (dataLength > 0 && add_sample (& samples, & sampleCount, & sampleCapacity, data, dataLength) < 0)
+              goto cleanup;
+            continue;
+        }
+
+        for (offset = 0; offset + 2 <= dataLength;)
+        {
+            size_t sampleLength = (data [offset] << 8) | data [offset + 1];
+
+            offset += 2;
+            if (sampleLength > dataLength - offset)
+            {
+                fprintf (stderr, "%s: truncated sample in %s\n", argv [0], argv [argi]);
+                goto cleanup;
+            }
+
+            if (sampleLength > 0 && add_sample (& samples, & sampleCount, & sampleCapacity, & data [offset], sampleLength) < 0)
+              goto cleanup;
+            offset += sampleLength;
+        }
+    }
+
+    rangeCoder = enet_range_coder_create ();
+    if (rangeCoder == NULL)
+      goto cleanup;
+
+    trained = enet_range_coder_train (rangeCoder, samples, sampleCount);
+    modelSize = enet_range_coder_save_model (rangeCoder, NULL, 0);
+    if (trained <= 0 || modelSize <= 0)
+    {
+        fprintf (stderr, "%s: no samples to train on\n", argv [0]);
+        goto cleanup;
+    }
+
+    model = (enet_uint8 *) malloc (modelSize);
+    if (model == NULL || enet_range_coder_save_model (rangeCoder, model, modelSize) != modelSize)
+      goto cleanup;
+
+    file = fopen (output, "wb");
+    if (file == NULL || fwrite (model, 1, modelSize, file) != modelSize)
+    {
+        fprintf (stderr, "%s: cannot write %s\n", argv [0], output);
+        if (file != NULL)
+          fclose (file);
+        goto cleanup;
+    }
+    fclose (file);
+
+    printf ("trained on %d of %u samples, model is %u bytes\n", trained, (unsigned) sampleCount, (unsigned) modelSize);
+    result = 0;
+
+cleanup:
+    if (rangeCoder != NULL)
+      enet_range_coder_destroy (rangeCoder);
+    while (fileCount > 0)
+      free (files [-- fileCount]);
+    free (files);
+    free (samples);
+    free (model);
+    return result;
+}
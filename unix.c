@@ -90,6 +90,16 @@ enet_time_get (void)
     return timeVal.tv_sec * 1000 + timeVal.tv_usec / 1000 - timeBase;
 }
 
+enet_uint32
+enet_time_get_microseconds (void)
+{
+    struct timeval timeVal;
+
+    gettimeofday (& timeVal, NULL);
+
+    return timeVal.tv_sec * 1000000 + timeVal.tv_usec;
+}
+
 void
 enet_time_set (enet_uint32 newTimeBase)
 {
@@ -352,6 +362,17 @@ enet_socket_set_option (ENetSocket socket, ENetSocketOption option, int value)
             result = setsockopt (socket, IPPROTO_IP, IP_TTL, (char *) & value, sizeof (int));
             break;
 
+        case ENET_SOCKOPT_DONTFRAGMENT:
+#if defined (IP_MTU_DISCOVER) && defined (IP_PMTUDISC_PROBE)
+            /* a negative value fragments even where the path MTU is not known to need it, while 0 restores the default */
+            value = value > 0 ? IP_PMTUDISC_PROBE : (value < 0 ? IP_PMTUDISC_DONT : IP_PMTUDISC_WANT);
+            result = setsockopt (socket, IPPROTO_IP, IP_MTU_DISCOVER, (char *) & value, sizeof (int));
+#elif defined (IP_DONTFRAG)
+            value = value > 0;
+            result = setsockopt (socket, IPPROTO_IP, IP_DONTFRAG, (char *) & value, sizeof (int));
+#endif
+            break;
+
         default:
             break;
     }
@@ -467,7 +488,8 @@ enet_socket_send (ENetSocket socket,
     
     if (sentLength == -1)
     {
-       if (errno == EWOULDBLOCK)
+       /* a datagram too large to send unfragmented is lost like any other */
+       if (errno == EWOULDBLOCK || errno == EMSGSIZE)
          return 0;
 
        return -1;
@@ -54,6 +54,20 @@ enet_time_get (void)
     return (enet_uint32) timeGetTime () - timeBase;
 }
 
+enet_uint32
+enet_time_get_microseconds (void)
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+      QueryPerformanceFrequency (& frequency);
+    QueryPerformanceCounter (& counter);
+
+    return (enet_uint32) ((counter.QuadPart / frequency.QuadPart) * 1000000 +
+                          (counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart);
+}
+
 void
 enet_time_set (enet_uint32 newTimeBase)
 {
@@ -236,6 +250,11 @@ enet_socket_set_option (ENetSocket socket, ENetSocketOption option, int value)
             result = setsockopt (socket, IPPROTO_IP, IP_TTL, (char *) & value, sizeof (int));
             break;
 
+        case ENET_SOCKOPT_DONTFRAGMENT:
+            value = value > 0;
+            result = setsockopt (socket, IPPROTO_IP, IP_DONTFRAGMENT, (char *) & value, sizeof (int));
+            break;
+
         default:
             break;
     }
@@ -347,7 +366,8 @@ enet_socket_send (ENetSocket socket,
                    NULL,
                    NULL) == SOCKET_ERROR)
     {
-       if (WSAGetLastError () == WSAEWOULDBLOCK)
+       /* a datagram too large to send unfragmented is lost like any other */
+       if (WSAGetLastError () == WSAEWOULDBLOCK || WSAGetLastError () == WSAEMSGSIZE)
          return 0;
 
        return -1;